@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Counts every allocation made through the global operator new. Link
+// alloc_counter.cpp into the binary to enable the interposition.
+namespace alloc_counter {
+
+struct Counts {
+  uint64_t allocations;
+  uint64_t bytes;
+};
+
+Counts counts();
+
+}
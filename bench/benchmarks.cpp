@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define RX_COUNTERS
+#include "rx.h"
+#include "rx/ingest.h"
+#include "rx/parallel.h"
+#include "bench/alloc_counter.h"
+#include "bench/perf_counters.h"
+
+using namespace rx;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+uint64_t nodeBytes = 0;
+uint64_t edgeBytes = 0;
+
+void countAllocations(AllocationKind kind, size_t bytes, bool allocated) {
+  if (allocated) {
+    (kind == AllocationKind::Node ? nodeBytes : edgeBytes) += bytes;
+  }
+}
+
+// A benchmark graph: `vars` are set round robin, `sinks` are read after
+// every set. Everything else is kept alive by `held`.
+struct Graph {
+  std::vector<VarT<unsigned>> vars;
+  std::vector<Reactive<unsigned>> sinks;
+  std::vector<Reactive<unsigned>> held;
+  size_t nodes = 0;
+};
+
+Rx<unsigned> inc(const Reactive<unsigned>& input) {
+  return input.map([] (unsigned in) {
+    return in + 1;
+  });
+}
+
+Rx<unsigned> combine(const Reactive<unsigned>& a, const Reactive<unsigned>& b) {
+  return reactives(a, b).reduce([] (unsigned a, unsigned b) {
+    return (a ^ b) + 1;
+  });
+}
+
+Graph chain(size_t n) {
+  Graph g;
+  g.vars.push_back(Var(0u));
+  Reactive<unsigned> last = g.vars[0];
+  for (size_t i = 1; i < n; i++) {
+    last = inc(last);
+  }
+  g.sinks.push_back(last);
+  g.nodes = n;
+  return g;
+}
+
+Graph fanOut(size_t n) {
+  Graph g;
+  g.vars.push_back(Var(0u));
+  for (size_t i = 1; i < n; i++) {
+    g.sinks.push_back(inc(g.vars[0]));
+  }
+  g.nodes = n;
+  return g;
+}
+
+Graph fanIn(size_t n) {
+  Graph g;
+  auto leaves = (n + 1) / 2;
+  std::vector<Reactive<unsigned>> level;
+  for (size_t i = 0; i < leaves; i++) {
+    g.vars.push_back(Var(0u));
+    level.push_back(g.vars.back());
+  }
+  g.nodes = leaves;
+  while (level.size() > 1) {
+    std::vector<Reactive<unsigned>> next;
+    for (size_t i = 0; i + 1 < level.size(); i += 2) {
+      next.push_back(combine(level[i], level[i + 1]));
+      g.nodes++;
+    }
+    if (level.size() % 2) {
+      next.push_back(level.back());
+    }
+    level = next;
+  }
+  g.sinks.push_back(level[0]);
+  return g;
+}
+
+Graph diamonds(size_t n) {
+  Graph g;
+  g.vars.push_back(Var(0u));
+  Reactive<unsigned> last = g.vars[0];
+  g.nodes = 1;
+  while (g.nodes + 3 <= n) {
+    auto left = inc(last);
+    auto right = inc(last);
+    last = combine(left, right);
+    g.nodes += 3;
+  }
+  g.sinks.push_back(last);
+  return g;
+}
+
+Graph randomDag(size_t n) {
+  Graph g;
+  std::mt19937 random(42);
+  auto numVars = std::max<size_t>(1, n / 100);
+  std::vector<Reactive<unsigned>> nodes;
+  std::vector<bool> consumed;
+  for (size_t i = 0; i < numVars; i++) {
+    g.vars.push_back(Var(0u));
+    nodes.push_back(g.vars.back());
+    consumed.push_back(false);
+  }
+  for (size_t i = numVars; i < n; i++) {
+    auto a = random() % i;
+    auto b = random() % i;
+    auto node = combine(nodes[a], nodes[b]);
+    consumed[a] = consumed[b] = true;
+    nodes.push_back(node);
+    consumed.push_back(false);
+    g.held.push_back(node);
+  }
+  for (size_t i = numVars; i < n; i++) {
+    if (!consumed[i]) {
+      g.sinks.push_back(nodes[i]);
+    }
+  }
+  g.nodes = n;
+  return g;
+}
+
+Graph observers(size_t n) {
+  Graph g;
+  g.vars.push_back(Var(0u));
+  for (size_t i = 1; i < n / 2; i++) {
+    auto node = inc(g.vars[0]);
+    node.observe([] (unsigned value) { });
+    g.held.push_back(node);
+  }
+  // The Var, plus a map and an observer per pair.
+  g.nodes = 1 + 2 * g.held.size();
+  return g;
+}
+
+struct Case {
+  const char* name;
+  Graph (*build)(size_t);
+};
+
+struct Options {
+  size_t minNodes = 10;
+  size_t maxNodes = 1000000;
+  double minSeconds = 0.2;
+  std::string filter;
+  bool hardwareCounters = true;
+  bool deactivateCold = false;
+  // Evaluate with a ParallelEvaluator when non-zero. Evaluation and hit
+  // counts are approximate then, as RX_COUNTERS is not thread-safe.
+  size_t threads = 0;
+};
+
+void run(const Case& c, size_t n, const Options& options, PerfCounters& perf, bool& first) {
+  nodeBytes = edgeBytes = 0;
+  auto allocsBefore = alloc_counter::counts();
+  auto buildStart = Clock::now();
+  auto graph = c.build(n);
+  auto buildNanos = std::chrono::duration<double, std::nano>(Clock::now() - buildStart).count();
+  auto allocsBuilt = alloc_counter::counts();
+
+  for (auto& sink : graph.sinks) {
+    sink.now();
+  }
+
+  std::vector<double> samples;
+  unsigned value = 1;
+  uint64_t allocations = 0;
+  auto countersBefore = Runtime::global().counters();
+  if (options.hardwareCounters) {
+    perf.start();
+  }
+  auto start = Clock::now();
+  auto elapsed = 0.0;
+  while (elapsed < options.minSeconds || samples.size() < 3) {
+    auto opAllocs = alloc_counter::counts().allocations;
+    auto opStart = Clock::now();
+    graph.vars[value % graph.vars.size()].set(value);
+    for (auto& sink : graph.sinks) {
+      sink.now();
+    }
+    auto opEnd = Clock::now();
+    allocations += alloc_counter::counts().allocations - opAllocs;
+    samples.push_back(std::chrono::duration<double, std::nano>(opEnd - opStart).count());
+    elapsed = std::chrono::duration<double>(opEnd - start).count();
+    value++;
+  }
+  auto hardware = options.hardwareCounters ? perf.stop() : std::vector<PerfCounters::Counter>();
+  auto ops = (double)samples.size();
+  auto signals = Runtime::global().counters().signals - countersBefore.signals;
+  auto hits = Runtime::global().counters().hits - countersBefore.hits;
+
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&](double p) {
+    return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))];
+  };
+
+  std::cout << (first ? "\n" : ",\n")
+    << "  {\"name\":\"" << c.name << "\""
+    << ",\"nodes\":" << graph.nodes
+    << ",\"threads\":" << options.threads
+    << ",\"ops\":" << samples.size()
+    << ",\"ns_per_op\":" << elapsed * 1e9 / ops
+    << ",\"p50_ns\":" << percentile(0.5)
+    << ",\"p99_ns\":" << percentile(0.99)
+    << ",\"ops_per_sec\":" << ops / elapsed
+    << ",\"evaluations_per_op\":" << (Runtime::global().counters().evaluations - countersBefore.evaluations) / ops
+    << ",\"signals_per_op\":" << signals / ops
+    << ",\"hits_per_op\":" << hits / ops
+    << ",\"allocations_per_op\":" << allocations / ops
+    << ",\"build_ns_per_node\":" << buildNanos / graph.nodes
+    << ",\"build_allocations_per_node\":"
+    << (double)(allocsBuilt.allocations - allocsBefore.allocations) / graph.nodes
+    << ",\"build_bytes_per_node\":"
+    << (double)(allocsBuilt.bytes - allocsBefore.bytes) / graph.nodes
+    << ",\"build_node_bytes_per_node\":" << (double)nodeBytes / graph.nodes
+    << ",\"build_edge_bytes_per_node\":" << (double)edgeBytes / graph.nodes;
+
+  if (hardware.empty()) {
+    std::cout << ",\"counters\":null";
+  } else {
+    std::cout << ",\"counters\":{";
+    for (size_t i = 0; i < hardware.size(); i++) {
+      const auto& counter = hardware[i];
+      std::cout << (i ? "," : "") << "\"" << counter.name << "_per_op\":" << counter.value / ops;
+      if (counter.cacheMiss) {
+        std::cout
+          << ",\"" << counter.name << "_per_signal\":" << (signals ? counter.value / (double)signals : 0.0)
+          << ",\"" << counter.name << "_per_hit\":" << (hits ? counter.value / (double)hits : 0.0);
+      }
+    }
+    std::cout << "}";
+  }
+  std::cout << "}" << std::flush;
+  first = false;
+}
+
+// Producer threads post to their own Vars through an Ingest while the
+// main thread drains; reports producer-side ingestion rate.
+void runIngest(const Options& options, bool& first) {
+  const size_t producers = 8;
+  const size_t varsPerProducer = 64;
+
+  Ingest ingest(producers * varsPerProducer);
+  std::vector<VarT<unsigned>> vars;
+  std::vector<IngestWriter<unsigned>> writers;
+  for (size_t i = 0; i < producers * varsPerProducer; i++) {
+    vars.push_back(Var(0u));
+    writers.push_back(ingest.writer(vars.back()));
+  }
+
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> posted(0);
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < producers; p++) {
+    threads.emplace_back([&, p] {
+      uint64_t count = 0;
+      unsigned value = 1;
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (size_t i = 0; i < varsPerProducer; i++) {
+          writers[p * varsPerProducer + i].set(value);
+        }
+        count += varsPerProducer;
+        value++;
+      }
+      posted += count;
+    });
+  }
+
+  uint64_t applied = 0;
+  uint64_t batches = 0;
+  auto start = Clock::now();
+  auto elapsed = 0.0;
+  while (elapsed < options.minSeconds) {
+    if (auto n = ingest.drain()) {
+      applied += n;
+      batches++;
+    } else {
+      std::this_thread::yield();
+    }
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  stop = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::cout << (first ? "\n" : ",\n")
+    << "  {\"name\":\"ingest\""
+    << ",\"nodes\":" << vars.size()
+    << ",\"producers\":" << producers
+    << ",\"updates_per_sec\":" << posted / elapsed
+    << ",\"applied_per_sec\":" << applied / elapsed
+    << ",\"vars_per_batch\":" << (batches ? (double)applied / batches : 0.0)
+    << "}" << std::flush;
+  first = false;
+}
+
+// Reads every node of a valid chain, once through the type-erased
+// Outputting interface and once through the final node type, which the
+// compiler can call directly and inline; reports the cost per read. Edges
+// between nodes still read through Outputting, so the difference is what a
+// typed edge would save per hop, not what propagation saves today.
+void runDispatch(const Options& options, bool& first) {
+  const size_t nodes = 1000;
+  using Node = RxNode<unsigned, unsigned>;
+
+  auto var = Var(0u);
+  std::vector<Reactive<unsigned>> held;
+  std::vector<Outputting<unsigned>*> erased;
+  std::vector<Node*> typed;
+  Reactive<unsigned> last = var;
+  for (size_t i = 0; i < nodes; i++) {
+    last = inc(last);
+    last.now();
+    held.push_back(last);
+    erased.push_back(last.node().get());
+    typed.push_back(static_cast<Node*>(last.node().get()));
+  }
+
+  auto measure = [&](auto& pointers) {
+    unsigned sum = 0;
+    uint64_t reads = 0;
+    auto start = Clock::now();
+    auto elapsed = 0.0;
+    while (elapsed < options.minSeconds) {
+      for (auto node : pointers) {
+        sum += node->now();
+      }
+      reads += pointers.size();
+      elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    volatile unsigned sink = sum;
+    static_cast<void>(sink);
+    return elapsed * 1e9 / reads;
+  };
+  auto virtualNanos = measure(erased);
+  auto finalNanos = measure(typed);
+
+  std::cout << (first ? "\n" : ",\n")
+    << "  {\"name\":\"dispatch\""
+    << ",\"nodes\":" << nodes
+    << ",\"virtual_ns_per_read\":" << virtualNanos
+    << ",\"final_ns_per_read\":" << finalNanos
+    << "}" << std::flush;
+  first = false;
+}
+
+void usage() {
+  std::cerr << "usage: benchmarks [--min-nodes N] [--max-nodes N] [--min-time SECONDS] [--filter NAME]"
+               " [--no-counters] [--deactivate-cold] [--threads N]\n";
+}
+
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--no-counters") {
+      options.hardwareCounters = false;
+      continue;
+    }
+    if (arg == "--deactivate-cold") {
+      options.deactivateCold = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    if (arg == "--min-nodes") {
+      options.minNodes = std::strtoull(argv[++i], nullptr, 10);
+      if (options.minNodes < 1) {
+        usage();
+        return 1;
+      }
+    } else if (arg == "--max-nodes") {
+      options.maxNodes = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--min-time") {
+      options.minSeconds = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--threads") {
+      options.threads = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--filter") {
+      options.filter = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  const Case cases[] = {
+    { "chain", chain },
+    { "fan_out", fanOut },
+    { "fan_in", fanIn },
+    { "diamonds", diamonds },
+    { "random_dag", randomDag },
+    { "observers", observers },
+  };
+
+  Runtime::global().setAllocationCallback(countAllocations);
+  Runtime::global().setColdNodeDeactivation(options.deactivateCold);
+
+  std::unique_ptr<ParallelEvaluator> parallel;
+  if (options.threads) {
+    parallel.reset(new ParallelEvaluator(options.threads));
+  }
+
+  PerfCounters perf;
+  if (options.hardwareCounters && !perf.available()) {
+    std::cerr << "hardware counters unavailable, reporting wall clock only" << std::endl;
+  }
+
+  bool first = true;
+  std::cout << "{\"benchmarks\":[";
+  for (const auto& c : cases) {
+    if (!options.filter.empty() && options.filter != c.name) {
+      continue;
+    }
+    for (size_t n = options.minNodes; n <= options.maxNodes; n *= 10) {
+      std::cerr << c.name << " " << n << std::endl;
+      run(c, n, options, perf, first);
+    }
+  }
+  if (options.filter.empty() || options.filter == "ingest") {
+    std::cerr << "ingest" << std::endl;
+    runIngest(options, first);
+  }
+  if (options.filter.empty() || options.filter == "dispatch") {
+    std::cerr << "dispatch" << std::endl;
+    runDispatch(options, first);
+  }
+  std::cout << "\n]}\n";
+  return 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters for the calling thread, read through perf_event_open.
+// Counters that cannot be opened (non-Linux, containers, restrictive
+// perf_event_paranoid) are skipped; if the cycle counter itself is missing
+// the whole group reports as unavailable.
+class PerfCounters {
+public:
+  struct Counter {
+    const char* name;
+    uint64_t value;
+    bool cacheMiss;
+  };
+
+  PerfCounters() {
+#ifdef __linux__
+    open("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, false);
+    if (!available()) {
+      return;
+    }
+    open("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, false);
+    open("l1d_misses", PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), true);
+    open("llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, true);
+    open("branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, false);
+#endif
+  }
+
+  ~PerfCounters() {
+#ifdef __linux__
+    for (auto& event : _events) {
+      close(event.fd);
+    }
+#endif
+  }
+
+  PerfCounters(PerfCounters const&) = delete;
+  void operator=(PerfCounters const&) = delete;
+
+  bool available() const {
+    return !_events.empty();
+  }
+
+  void start() {
+#ifdef __linux__
+    if (available()) {
+      ioctl(_events[0].fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(_events[0].fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+  }
+
+  std::vector<Counter> stop() {
+    std::vector<Counter> counters;
+#ifdef __linux__
+    if (available()) {
+      ioctl(_events[0].fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+      for (auto& event : _events) {
+        uint64_t value = 0;
+        if (read(event.fd, &value, sizeof(value)) == sizeof(value)) {
+          counters.push_back({ event.name, value, event.cacheMiss });
+        }
+      }
+    }
+#endif
+    return counters;
+  }
+
+private:
+  struct Event {
+    const char* name;
+    int fd;
+    bool cacheMiss;
+  };
+
+#ifdef __linux__
+  void open(const char* name, uint32_t type, uint64_t config, bool cacheMiss) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = _events.empty() ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    auto group = _events.empty() ? -1 : _events[0].fd;
+    auto fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+    if (fd >= 0) {
+      _events.push_back({ name, fd, cacheMiss });
+    }
+  }
+#endif
+
+  std::vector<Event> _events;
+};
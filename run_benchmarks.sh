@@ -0,0 +1,9 @@
+#!/bin/bash
+if [ ! -d build-release ]; then
+  meson . build-release --buildtype=release
+fi
+cd build-release
+ninja benchmarks
+if [ -f benchmarks ]; then
+  ./benchmarks "$@"
+fi
@@ -1,11 +1,842 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <ratio>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
 #include <vector>
 
+#ifdef RX_PROFILE
+#include <chrono>
+#endif
+
+#ifdef RX_TRACE
+#include "rx/trace.h"
+#define RX_TRACE_SCOPE(phase, node) \
+  ::rx::trace::Scope _rxTraceScope(::rx::trace::Phase::phase, node)
+#else
+#define RX_TRACE_SCOPE(phase, node)
+#endif
+
 namespace rx {
 
+struct NodeStats {
+  uint64_t evaluations = 0;
+  uint64_t nanoseconds = 0;
+};
+
+#ifdef RX_PROFILE
+inline void record(NodeStats& stats, std::chrono::steady_clock::time_point start) {
+  stats.evaluations += 1;
+  stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+#ifdef RX_COUNTERS
+// Propagation counters of one runtime, for benchmarking.
+struct Counters {
+  uint64_t signals = 0;
+  uint64_t hits = 0;
+  uint64_t evaluations = 0;
+  uint64_t evictions = 0;
+};
+#endif
+
+enum class AllocationKind { Node, Edge };
+
+// Called for every allocation and deallocation minirx makes for nodes and
+// their output lists. Closures held by std::function are not covered.
+using AllocationCallback = void (*)(AllocationKind kind, size_t bytes, bool allocated);
+
+class Node;
+
+namespace detail {
+
+// Place of a node's cache in its runtime's list of caches, most recently
+// read first. Lives in the node so that reads move it in constant time.
+struct CacheEntry {
+  const Node* node;
+  CacheEntry* newer = nullptr;
+  CacheEntry* older = nullptr;
+  size_t bytes = 0;
+};
+
+}
+
+// Bytes a cached value holds, for the cache budget. Specialize for other
+// types that own heap memory.
+template <typename T>
+struct CacheSize {
+  static size_t of(const T& value) {
+    return sizeof(T);
+  }
+};
+
+template <typename T, typename A>
+struct CacheSize<std::vector<T, A>> {
+  static size_t of(const std::vector<T, A>& value) {
+    return sizeof(value) + value.capacity() * sizeof(T);
+  }
+};
+
+template <typename C, typename Traits, typename A>
+struct CacheSize<std::basic_string<C, Traits, A>> {
+  static size_t of(const std::basic_string<C, Traits, A>& value) {
+    return sizeof(value) + value.capacity() * sizeof(C);
+  }
+};
+class RxException : public std::runtime_error {
+public:
+  explicit RxException(const char* what_arg) :
+    std::runtime_error(what_arg) {}
+};
+
+// Work that must only run once a propagation has reached every node it is
+// going to invalidate, such as observer callbacks.
+class Deferred {
+public:
+  virtual ~Deferred() { }
+  virtual void run() = 0;
+
+  // Whether an evaluator may hold this work back to a later frame.
+  virtual bool postponable() const {
+    return false;
+  }
+};
+
+// Optional eager evaluation strategy. Receives every node invalidated during
+// a propagation and evaluates them before deferred work runs.
+class Evaluator {
+public:
+  virtual ~Evaluator() { }
+  virtual void invalidated(const Node* node) = 0;
+  virtual void evaluate() = 0;
+
+  // Called before a Var is assigned, a derived node is read or the graph
+  // is changed, for evaluators that touch nodes outside of propagation.
+  virtual void access() { }
+
+  // Called when a derived node is destroyed.
+  virtual void destroyed(const Node* node) { }
+
+  // Offered postponable deferred work at the end of a propagation. Returns
+  // whether the evaluator took it over.
+  virtual bool postpone(const std::shared_ptr<Deferred>& work) {
+    return false;
+  }
+};
+
+// Owns everything a graph shares between its nodes: signal ids, the
+// propagation and revision state, the evaluator, the allocation hook and
+// counters. Nodes are bound to the runtime of their inputs. A runtime is
+// not thread-safe, but separate runtimes share no state, so each can be
+// driven from its own thread.
+class Runtime {
+public:
+  // The implicit runtime used when none is given.
+  static Runtime& global() {
+    static Runtime _global;
+    return _global;
+  }
+
+  Runtime() { }
+
+  Runtime(Runtime const&) = delete;
+  void operator=(Runtime const&) = delete;
+
+  uint32_t nextSignalId() {
+    if (signalId == 0) {
+      signalId = 1;
+    }
+    return signalId++;
+  }
+
+  // Each outermost propagation, including the deferred work it triggers,
+  // forms one revision of the graph.
+  void beginPropagation() {
+    if (depth++ == 0 && !flushing) {
+      revision++;
+    }
+  }
+
+  // Runs deferred work once the outermost propagation ends, then notifies
+  // commit listeners. Propagations started by deferred work queue onto the
+  // same flush. If the evaluator throws, the flush still runs before the
+  // exception is rethrown.
+  void endPropagation() {
+    std::exception_ptr error;
+    if (--depth == 0 && installedEvaluator) {
+      try {
+        installedEvaluator->evaluate();
+      } catch (...) {
+        error = std::current_exception();
+      }
+    }
+    if (depth == 0 && !flushing) {
+      flush();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // Ends a propagation that a node function or observer threw out of.
+  // Deferred work stays queued and runs with the next flush.
+  void abandonPropagation() {
+    --depth;
+  }
+
+  // Brackets a propagation, so that an exception thrown by a node function
+  // or observer leaves the runtime usable.
+  class Propagation {
+  public:
+    explicit Propagation(Runtime& runtime) : _runtime(runtime) {
+      _runtime.beginPropagation();
+    }
+
+    ~Propagation() {
+      if (!_ended) {
+        _runtime.abandonPropagation();
+      }
+    }
+
+    Propagation(Propagation const&) = delete;
+    void operator=(Propagation const&) = delete;
+
+    void end() {
+      _ended = true;
+      _runtime.endPropagation();
+    }
+
+  private:
+    Runtime& _runtime;
+    bool _ended = false;
+  };
+
+  void defer(std::weak_ptr<Deferred> work) {
+    deferred.push_back(std::move(work));
+  }
+
+  void addCommitListener(std::weak_ptr<Deferred> listener) {
+    commitListeners.erase(
+      std::remove_if(
+        begin(commitListeners),
+        end(commitListeners),
+        [](const std::weak_ptr<Deferred>& ptr) { return ptr.expired(); }),
+      end(commitListeners));
+    commitListeners.push_back(std::move(listener));
+  }
+
+  uint64_t currentRevision() const {
+    return revision;
+  }
+
+  // Counts changes to Var values; nodes stamp themselves with it.
+  uint64_t changeCount() const {
+    return changes;
+  }
+
+  uint64_t nextChange() {
+    return ++changes;
+  }
+
+  // When enabled, derived nodes that nothing observes stop receiving
+  // signals and validate themselves against their inputs when read.
+  bool deactivatesColdNodes() const {
+    return deactivateCold;
+  }
+
+  void setColdNodeDeactivation(bool enabled) {
+    deactivateCold = enabled;
+  }
+
+  // By default observers run as soon as a signal reaches them, and may see
+  // nodes the propagation has not invalidated yet. When deferred, they run
+  // once the outermost propagation has reached every node, so they never
+  // see a mix of old and new values.
+  bool defersObservers() const {
+    return deferObservers;
+  }
+
+  void setObserverDeferral(bool enabled) {
+    deferObservers = enabled;
+  }
+
+  // Bounds the memory held by cached values of derived nodes. When over
+  // budget, the caches read least recently are dropped and recomputed on
+  // demand. Pinned nodes are never dropped and do not count toward the
+  // budget. Caches are trimmed after each propagation and each read through
+  // a Reactive, or by trimCaches(). SIZE_MAX, the default, disables
+  // tracking.
+  void setCacheBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cacheBudget.store(bytes, std::memory_order_relaxed);
+    if (bytes == SIZE_MAX) {
+      while (newest) {
+        unlinkCache(newest);
+      }
+    }
+  }
+
+  bool hasCacheBudget() const {
+    return cacheBudget.load(std::memory_order_relaxed) != SIZE_MAX;
+  }
+
+  // Bytes held by the caches that count toward the budget.
+  size_t cachedBytes() const {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return cachedBytesTotal;
+  }
+
+  // Records that a node's cache, now holding bytes, was computed or read by
+  // the application, making it the most recently read. Safe to call from
+  // parallel evaluators.
+  void cacheRead(detail::CacheEntry* entry, size_t bytes);
+
+  void forgetCache(detail::CacheEntry* entry) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (cached(entry)) {
+      unlinkCache(entry);
+    }
+  }
+
+  // Drops caches until within budget. Does nothing while a propagation is
+  // running or nodes are being evaluated on this thread, since the caches
+  // it would drop may be in use.
+  void trimCaches();
+
+  Evaluator* evaluator() const {
+    return installedEvaluator;
+  }
+
+  // Lets the evaluator stop any work it runs alongside this thread before
+  // nodes are read or changed.
+  void access() {
+    if (installedEvaluator) {
+      installedEvaluator->access();
+    }
+  }
+
+  // A runtime has one evaluator at a time; installing a second one throws
+  // rather than silently replacing the first. Pass null to uninstall.
+  void setEvaluator(Evaluator* evaluator) {
+    if (evaluator && installedEvaluator && evaluator != installedEvaluator) {
+      throw RxException("Runtime already has an evaluator");
+    }
+    installedEvaluator = evaluator;
+  }
+
+  AllocationCallback allocationCallback() const {
+    return _allocationCallback;
+  }
+
+  void setAllocationCallback(AllocationCallback callback) {
+    _allocationCallback = callback;
+  }
+
+#ifdef RX_COUNTERS
+  Counters& counters() {
+    return _counters;
+  }
+#endif
+
+  // Nodes reached by the current propagation that still have to forward
+  // the signal to their outputs.
+  std::vector<std::shared_ptr<Node>>& pendingSignals() {
+    return _pendingSignals;
+  }
+
+private:
+  // Work that throws is dropped, and work queued after it is kept for the
+  // next flush.
+  void flush() {
+    flushing = true;
+    size_t i = 0;
+    try {
+      for (; i < deferred.size(); i++) {
+        if (auto work = deferred[i].lock()) {
+          if (!(installedEvaluator && work->postponable() && installedEvaluator->postpone(work))) {
+            work->run();
+          }
+        }
+      }
+      deferred.clear();
+      if (hasCacheBudget()) {
+        trimCaches();
+      }
+      for (const auto& listener : commitListeners) {
+        if (auto tmp = listener.lock()) {
+          tmp->run();
+        }
+      }
+    } catch (...) {
+      deferred.erase(begin(deferred), begin(deferred) + std::min(i + 1, deferred.size()));
+      flushing = false;
+      throw;
+    }
+    flushing = false;
+  }
+
+  bool cached(const detail::CacheEntry* entry) const {
+    return entry->newer || newest == entry;
+  }
+
+  void linkCache(detail::CacheEntry* entry) {
+    entry->older = newest;
+    if (newest) {
+      newest->newer = entry;
+    } else {
+      oldest = entry;
+    }
+    newest = entry;
+    cachedBytesTotal += entry->bytes;
+  }
+
+  void unlinkCache(detail::CacheEntry* entry) {
+    (entry->newer ? entry->newer->older : newest) = entry->older;
+    (entry->older ? entry->older->newer : oldest) = entry->newer;
+    entry->newer = nullptr;
+    entry->older = nullptr;
+    cachedBytesTotal -= entry->bytes;
+  }
+
+  uint32_t signalId = 1;
+  uint32_t depth = 0;
+  bool flushing = false;
+  uint64_t revision = 0;
+  uint64_t changes = 0;
+  bool deactivateCold = false;
+  bool deferObservers = false;
+  std::atomic<size_t> cacheBudget { SIZE_MAX };
+  size_t cachedBytesTotal = 0;
+  // Unpinned caches, most recently read first.
+  detail::CacheEntry* newest = nullptr;
+  detail::CacheEntry* oldest = nullptr;
+  std::vector<const Node*> evicted;
+  mutable std::mutex cacheMutex;
+  Evaluator* installedEvaluator = nullptr;
+  AllocationCallback _allocationCallback = nullptr;
+  std::vector<std::weak_ptr<Deferred>> deferred;
+  std::vector<std::weak_ptr<Deferred>> commitListeners;
+  std::vector<std::shared_ptr<Node>> _pendingSignals;
+#ifdef RX_COUNTERS
+  Counters _counters;
+#endif
+};
+
+// Routes node and edge allocations through the runtime's allocation hook.
+// The kind is part of the type, so the allocator is a single pointer.
+template <typename T, AllocationKind Kind = AllocationKind::Node>
+class Allocator {
+public:
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = Allocator<U, Kind>;
+  };
+
+  explicit Allocator(Runtime& runtime) : runtime(&runtime) { }
+
+  template <typename U>
+  Allocator(const Allocator<U, Kind>& other) : runtime(other.runtime) { }
+
+  T* allocate(size_t n) {
+    if (auto callback = runtime->allocationCallback()) {
+      callback(Kind, n * sizeof(T), true);
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (auto callback = runtime->allocationCallback()) {
+      callback(Kind, n * sizeof(T), false);
+    }
+    ::operator delete(p);
+  }
+
+  template <typename U>
+  bool operator==(const Allocator<U, Kind>& other) const {
+    return runtime == other.runtime;
+  }
+
+  template <typename U>
+  bool operator!=(const Allocator<U, Kind>& other) const {
+    return !(*this == other);
+  }
+
+  Runtime* runtime;
+};
+
+namespace detail {
+
+// Output list of a node. Unlike a vector with the runtime's allocator, it
+// keeps no allocator of its own and fits in 16 bytes: the node passes its
+// runtime to every call that allocates, and releases the storage in its
+// destructor.
+template <typename P>
+class EdgeList {
+public:
+  EdgeList() { }
+
+  EdgeList(EdgeList const&) = delete;
+  void operator=(EdgeList const&) = delete;
+
+  P* begin() const {
+    return _data;
+  }
+
+  P* end() const {
+    return _data + _size;
+  }
+
+  size_t size() const {
+    return _size;
+  }
+
+  bool empty() const {
+    return _size == 0;
+  }
+
+  void push_back(Runtime& runtime, P value) {
+    if (_size == _capacity) {
+      reallocate(runtime, _capacity ? 2 * _capacity : 1);
+    }
+    new (_data + _size) P(std::move(value));
+    _size++;
+  }
+
+  // Destroys the entries from first on.
+  void truncate(P* first) {
+    for (auto it = first; it != end(); ++it) {
+      it->~P();
+    }
+    _size = static_cast<uint32_t>(first - _data);
+  }
+
+  void shrink(Runtime& runtime) {
+    if (_size < _capacity) {
+      reallocate(runtime, _size);
+    }
+  }
+
+  void release(Runtime& runtime) {
+    truncate(begin());
+    reallocate(runtime, 0);
+  }
+
+private:
+  void reallocate(Runtime& runtime, uint32_t capacity) {
+    Allocator<P, AllocationKind::Edge> allocator(runtime);
+    P* data = capacity ? allocator.allocate(capacity) : nullptr;
+    for (uint32_t i = 0; i < _size; i++) {
+      new (data + i) P(std::move(_data[i]));
+      _data[i].~P();
+    }
+    if (_data) {
+      allocator.deallocate(_data, _capacity);
+    }
+    _data = data;
+    _capacity = capacity;
+  }
+
+  P* _data = nullptr;
+  uint32_t _size = 0;
+  uint32_t _capacity = 0;
+};
+
+}
+
+// Allocates a node in the given runtime. Node constructors take the runtime
+// as their first argument.
+template <typename T, typename... Args>
+std::shared_ptr<T> makeNode(Runtime& runtime, Args&&... args) {
+  return std::allocate_shared<T>(
+    Allocator<T>(runtime), runtime, std::forward<Args>(args)...);
+}
+
+// State read on every signal and cache hit, packed into one word that sits
+// right after the vtable and runtime pointers.
+struct NodeHeader {
+  NodeHeader() : height(0), active(1), upToDate(0), recheck(0), compact(0), pinned(0) { }
+
+  // Last signal received, so that each is forwarded once.
+  uint32_t signalId = 0;
+  uint32_t height : 27;
+  uint32_t active : 1;
+  uint32_t upToDate : 1;
+  // Set when a node may have missed signals while inactive.
+  uint32_t recheck : 1;
+  // Set when an output deactivated and the outputs should be compacted.
+  uint32_t compact : 1;
+  // Set when the cached value must survive the cache budget.
+  uint32_t pinned : 1;
+};
+
+static_assert(sizeof(NodeHeader) == 8, "node header should be one word");
+
+// Type-erased view of a graph node, used for walking and exporting the graph.
+class Node {
+public:
+  enum class Kind { Var, Rx, Observer };
+
+  Node(Runtime& runtime) : _runtime(&runtime) { }
+
+  virtual ~Node() { }
+
+  Runtime& runtime() const {
+    return *_runtime;
+  }
+
+  virtual Kind kind() const = 0;
+
+  virtual void visitInputs(const std::function<void(const Node*)>& visit) const { }
+
+  // Visits live outputs; sticky outputs are owned by this node.
+  virtual void visitOutputs(const std::function<void(const Node*, bool sticky)>& visit) const { }
+
+  virtual NodeStats stats() const {
+    return NodeStats();
+  }
+
+  // Longest path from a Var; every input has a lower height.
+  uint32_t height() const {
+    return _header.height;
+  }
+
+  // Whether the cached value can be read without evaluating.
+  virtual bool valid() const {
+    return true;
+  }
+
+  // Brings the cached value up to date.
+  virtual void refresh() const { }
+
+  // First input that is not valid, if any.
+  virtual const Node* invalidInput() const {
+    return nullptr;
+  }
+
+  // Called from the propagation worklist when an input changed.
+  virtual void signal(uint32_t signalId) { }
+
+  // Whether the node is subscribed to its inputs and receives signals.
+  bool active() const {
+    return _header.active;
+  }
+
+  // Subscribes the node to its inputs again, adding inputs that are not
+  // active themselves to inactive.
+  virtual void activate(std::vector<Node*>& inactive) { }
+
+  // Exempts the cached value from the runtime's cache budget.
+  void pin(bool pinned = true) {
+    runtime().access();
+    _header.pinned = pinned;
+    if (auto entry = cacheEntry()) {
+      if (pinned) {
+        runtime().forgetCache(entry);
+      }
+    }
+  }
+
+  bool pinned() const {
+    return _header.pinned;
+  }
+
+  // Drops the cached value; the next read recomputes it.
+  virtual void evict() const { }
+
+  // Where the runtime tracks the cached value, if the node has one.
+  virtual detail::CacheEntry* cacheEntry() const {
+    return nullptr;
+  }
+
+  // Whether the node was read since it last became valid, other than by
+  // the evaluation of another node. Only tracked while an evaluator is
+  // installed.
+  virtual bool hot() const {
+    return false;
+  }
+
+  // The rest is used by the optimizer in rx/optimize.h.
+
+  // Whether the node can stop receiving signals and validate itself on
+  // read instead.
+  virtual bool canDeactivate() const {
+    return false;
+  }
+
+  virtual void deactivate() { }
+
+  // Type of the node's function and, for function pointers, its address.
+  // False if the function has state, so that two nodes cannot be compared.
+  virtual bool identity(const std::type_info*& type, uintptr_t& function) const {
+    return false;
+  }
+
+  // The only active output, if there is exactly one and no sticky output.
+  virtual std::weak_ptr<Node> soleOutput() const {
+    return std::weak_ptr<Node>();
+  }
+
+  // Adds an output without activating this node.
+  virtual void attachOutput(const std::weak_ptr<Node>& output) const { }
+
+  // Drops expired outputs and outputs that have deactivated.
+  virtual void compactOutputs() const { }
+
+  // Moves every output over to an identical node of the same type and
+  // deactivates. Returns false, leaving some outputs in place, if an output
+  // cannot switch inputs.
+  virtual bool mergeInto(Node* canonical) {
+    return false;
+  }
+
+  // Switches every input that is from over to to, which has the same value
+  // type. Returns whether any input was switched.
+  virtual bool replaceInput(const Node* from, const std::shared_ptr<Node>& to) {
+    return false;
+  }
+
+private:
+  Runtime* _runtime;
+
+protected:
+  mutable NodeHeader _header;
+};
+
+inline void Runtime::cacheRead(detail::CacheEntry* entry, size_t bytes) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  if (!hasCacheBudget() || entry->node->pinned()) {
+    return;
+  }
+  if (cached(entry)) {
+    unlinkCache(entry);
+  }
+  entry->bytes = bytes;
+  linkCache(entry);
+}
+
+namespace detail {
+
+// Number of node evaluations and refreshes running on this thread. Reads
+// made inside them are not reads by the application.
+inline uint32_t& evaluationDepth() {
+  static thread_local uint32_t depth = 0;
+  return depth;
+}
+
+}
+
+inline void Runtime::trimCaches() {
+  // Worker threads are always inside an evaluation, so depth is only read
+  // on the thread that owns the graph.
+  if (detail::evaluationDepth() != 0 || depth != 0 || !hasCacheBudget()) {
+    return;
+  }
+  access();
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto budget = cacheBudget.load(std::memory_order_relaxed);
+    while (cachedBytesTotal > budget) {
+      evicted.push_back(oldest->node);
+      unlinkCache(oldest);
+    }
+  }
+  for (auto node : evicted) {
+    node->evict();
+    #ifdef RX_COUNTERS
+      _counters.evictions += 1;
+    #endif
+  }
+  evicted.clear();
+}
+
+namespace detail {
+
+struct EvaluationScope {
+  EvaluationScope() {
+    evaluationDepth()++;
+  }
+
+  ~EvaluationScope() {
+    evaluationDepth()--;
+  }
+};
+
+// Brings every invalid input of root up to date, lowest first, with an
+// explicit stack so that evaluation depth is bounded only by memory. The
+// stack is per thread because parallel evaluators refresh nodes from
+// worker threads.
+inline void refreshInputs(const Node* root) {
+  static thread_local std::vector<const Node*> stack;
+  auto base = stack.size();
+  stack.push_back(root);
+  while (stack.size() > base) {
+    auto node = stack.back();
+    if (auto input = node->invalidInput()) {
+      stack.push_back(input);
+      continue;
+    }
+    stack.pop_back();
+    if (node != root) {
+      node->refresh();
+    }
+  }
+}
+
+// Activates root and every inactive node upstream of it.
+inline void activate(Node* root) {
+  static thread_local std::vector<Node*> inactive;
+  root->runtime().access();
+  auto base = inactive.size();
+  inactive.push_back(root);
+  while (inactive.size() > base) {
+    auto node = inactive.back();
+    inactive.pop_back();
+    if (!node->active()) {
+      node->activate(inactive);
+    }
+  }
+}
+
+// Drops a reference to a node. When that destroys a node which releases
+// its own inputs, they are queued here rather than destroyed recursively,
+// so that tearing down a long chain does not overflow the stack.
+inline void release(std::shared_ptr<Node>&& node) {
+  static thread_local std::vector<std::shared_ptr<Node>> graveyard;
+  static thread_local bool releasing = false;
+  if (node.use_count() != 1) {
+    return;
+  }
+  graveyard.push_back(std::move(node));
+  if (releasing) {
+    return;
+  }
+  releasing = true;
+  while (!graveyard.empty()) {
+    auto next = std::move(graveyard.back());
+    graveyard.pop_back();
+    next.reset();
+  }
+  releasing = false;
+}
+
+}
+
 template <typename T>
 class Observable {
 public:
@@ -14,103 +845,380 @@ public:
   virtual ~Observable() { }
 };
 
-class Signallable {
-public:
-  virtual ~Signallable() { }
-  virtual void signal(uint8_t signalId) = 0;
+template <typename T>
+class Outputting : public Node {
+public:
+  Outputting(Runtime& runtime) : Node(runtime) { }
+
+  Outputting(Runtime& runtime, T value) : Node(runtime), _value(value) { }
+
+  void addOutput(std::weak_ptr<Node> r) {
+    attach(std::move(r));
+    if (!this->active()) {
+      detail::activate(this);
+    }
+  }
+
+  void addStickyOutput(std::shared_ptr<Node> r) {
+    this->runtime().access();
+    _stickyOutputs.push_back(this->runtime(), std::move(r));
+    if (!this->active()) {
+      detail::activate(this);
+    }
+  }
+
+  // Adds an output without activating this node.
+  void attach(std::weak_ptr<Node> r) const {
+    this->runtime().access();
+    if (this->_header.compact) {
+      _clean();
+    }
+    _outputs.push_back(this->runtime(), std::move(r));
+  }
+
+  void attachOutput(const std::weak_ptr<Node>& output) const override {
+    attach(output);
+  }
+
+  void compactOutputs() const override {
+    this->_header.compact = true;
+    _clean();
+    _outputs.shrink(this->runtime());
+  }
+
+  std::weak_ptr<Node> soleOutput() const override {
+    std::shared_ptr<Node> sole;
+    if (!_stickyOutputs.empty()) {
+      return sole;
+    }
+    for (const auto& output : _outputs) {
+      auto tmp = output.lock();
+      if (!tmp || !tmp->active() || tmp == sole) {
+        continue;
+      }
+      if (sole) {
+        return std::weak_ptr<Node>();
+      }
+      sole = tmp;
+    }
+    return sole;
+  }
+
+  // Called by an output that deactivated; it is dropped on the next pass
+  // over the outputs.
+  void requestCompaction() {
+    this->_header.compact = true;
+  }
+
+  // Stamp of the newest Var change this value reflects.
+  uint64_t changed() const {
+    return _changed;
+  }
+
+  virtual ~Outputting() {
+    _outputs.release(this->runtime());
+    _stickyOutputs.release(this->runtime());
+  }
+
+  virtual T now() const = 0;
+
+  void visitOutputs(const std::function<void(const Node*, bool sticky)>& visit) const override {
+    for (const auto& output : _outputs) {
+      if (auto tmp = output.lock()) {
+        visit(tmp.get(), false);
+      }
+    }
+    for (const auto& output : _stickyOutputs) {
+      visit(output.get(), true);
+    }
+  }
+
+#ifdef DEBUG
+  void clean() {
+    _clean();
+  }
+
+  size_t numOutputs() {
+    return _outputs.size();
+  }
+#endif
+
+
+protected:
+
+  // Switches every output over to to. Returns whether all of them did.
+  bool redirectOutputs(const std::shared_ptr<Node>& to) {
+    if (!_stickyOutputs.empty()) {
+      return false;
+    }
+    std::vector<Node*> redirected;
+    auto all = true;
+    for (auto& output : _outputs) {
+      auto tmp = output.lock();
+      if (!tmp) {
+        continue;
+      }
+      auto seen = std::find(begin(redirected), end(redirected), tmp.get()) != end(redirected);
+      if (!seen && tmp->replaceInput(this, to)) {
+        redirected.push_back(tmp.get());
+        to->attachOutput(output);
+        seen = true;
+      }
+      if (seen) {
+        output.reset();
+      } else {
+        all = false;
+      }
+    }
+    _clean();
+    return all;
+  }
+
+  // Signals every node downstream, depth first, using the runtime's
+  // worklist instead of recursion. The worklist holds the references taken
+  // while queueing, so observers running mid-walk cannot destroy queued
+  // nodes.
+  void forwardSignal(uint32_t signalId) const {
+    // Drops what is left of this walk if a node function or observer
+    // throws, so that the next propagation does not pick it up.
+    struct Truncate {
+      std::vector<std::shared_ptr<Node>>& pending;
+      size_t base;
+
+      ~Truncate() {
+        if (pending.size() > base) {
+          pending.erase(begin(pending) + base, end(pending));
+        }
+      }
+    };
+    auto& pending = this->runtime().pendingSignals();
+    auto base = pending.size();
+    Truncate truncate { pending, base };
+    queueOutputs(pending);
+    while (pending.size() > base) {
+      auto next = std::move(pending.back());
+      pending.pop_back();
+      #ifdef RX_COUNTERS
+        this->runtime().counters().signals += 1;
+      #endif
+      next->signal(signalId);
+    }
+  }
+
+  // Pushes the outputs in reverse, so they are signalled in order.
+  // Returns the number of outputs queued.
+  size_t queueOutputs(std::vector<std::shared_ptr<Node>>& pending) const {
+    if (this->_header.compact) {
+      _clean();
+    }
+    auto base = pending.size();
+    for (auto it = _stickyOutputs.end(); it != _stickyOutputs.begin(); ) {
+      pending.push_back(*--it);
+    }
+    auto cleanup = false;
+    for (auto it = _outputs.end(); it != _outputs.begin(); ) {
+      if (auto tmp = (--it)->lock()) {
+        pending.push_back(std::move(tmp));
+      } else {
+        cleanup = true;
+      }
+    }
+    if (cleanup) {
+      _clean();
+    }
+    return pending.size() - base;
+  }
+
+private:
+  void _clean() const {
+    bool compact = this->_header.compact;
+    this->_header.compact = false;
+    _outputs.truncate(
+      std::remove_if(
+        _outputs.begin(),
+        _outputs.end(),
+        [compact](const std::weak_ptr<Node>& ptr) {
+          if (!compact) {
+            return ptr.expired();
+          }
+          auto tmp = ptr.lock();
+          return !tmp || !tmp->active();
+        }));
+  }
+
+  // Ordered so that the header, a value of up to eight bytes and both
+  // output lists, in the order queueOutputs() reads them, fill the first
+  // cache line. The change stamp is only read when an output evaluates.
+protected:
+  // Value of a Var, cached value of a derived node.
+  mutable T _value;
+
 private:
+  mutable detail::EdgeList<std::shared_ptr<Node>> _stickyOutputs;
+  mutable detail::EdgeList<std::weak_ptr<Node>> _outputs;
 
+protected:
+  mutable uint64_t _changed = 0;
 };
 
+template<int ...>
+struct seq {};
+
+template<int N, int ...S>
+struct gen_seq : gen_seq<N-1, N-1, S...> {};
 
-template <typename T>
-class Outputting {
+template<int ...S>
+struct gen_seq<0, S...>{
+  typedef seq<S...> type;
+};
+
+// Base of derived nodes. Derived supplies receivedSignal() and
+// reactivated(), which are called without virtual dispatch.
+template <typename Derived, typename R, typename... Types>
+class Routable :
+  public Outputting<R>,
+  public std::enable_shared_from_this<Derived> {
 public:
+  Routable(Runtime& runtime, std::shared_ptr<Outputting<Types>>... inputs) :
+      Outputting<R>(runtime),
+      _inputs(std::tie(inputs...)) {
+    runtime.access();
+    uint32_t heights[] = { 0, inputs->height()... };
+    this->_header.height = 1 + *std::max_element(std::begin(heights), std::end(heights));
+  }
 
-  void addOutput(std::weak_ptr<Signallable> r) {
-    _outputs.push_back(r);
+  virtual ~Routable() {
+    releaseInputs(typename gen_seq<sizeof...(Types)>::type());
   }
 
-  void addStickyOutput(std::shared_ptr<Signallable> r) {
-    _stickyOutputs.push_back(r);
+  // Called from the propagation worklist, which forwards the signal on.
+  // Inactive nodes may still be listed by an input until it compacts.
+  void signal(uint32_t signalId) override {
+    if (this->_header.active && signalId != this->_header.signalId) {
+      this->_header.signalId = signalId;
+      static_cast<Derived*>(this)->receivedSignal();
+      auto queued = this->queueOutputs(this->runtime().pendingSignals());
+      if (queued == 0 && this->runtime().deactivatesColdNodes()) {
+        deactivate(typename gen_seq<sizeof...(Types)>::type());
+      }
+    }
   }
 
-  virtual ~Outputting() { }
+  void activate(std::vector<Node*>& inactive) override {
+    activate(inactive, typename gen_seq<sizeof...(Types)>::type());
+  }
 
-  virtual T now() const = 0;
+  bool canDeactivate() const override {
+    return true;
+  }
 
-#ifdef DEBUG
-  void clean() {
-    _clean();
+  void deactivate() override {
+    this->runtime().access();
+    if (this->_header.active) {
+      deactivate(typename gen_seq<sizeof...(Types)>::type());
+    }
   }
 
-  size_t numOutputs() {
-    return _outputs.size();
+  bool replaceInput(const Node* from, const std::shared_ptr<Node>& to) override {
+    return replaceInput(from, to, typename gen_seq<sizeof...(Types)>::type());
   }
-#endif
 
+  void visitInputs(const std::function<void(const Node*)>& visit) const override {
+    visitInputs(visit, typename gen_seq<sizeof...(Types)>::type());
+  }
 
-protected:
+  const Node* invalidInput() const override {
+    return invalidInput(typename gen_seq<sizeof...(Types)>::type());
+  }
 
-  void forwardSignal(uint8_t signalId) const {
-    auto cleanup = false;
-    for (auto observer : _outputs) {
-      if (auto tmp = observer.lock()) {
-        tmp->signal(signalId);
-      } else {
-        cleanup = true;
+protected:
+  template<int ...S>
+  const Node* invalidInput(seq<S...>) const {
+    const Node* inputs[] = { nullptr, std::get<S>(_inputs).get()... };
+    for (size_t i = 1; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+      if (!inputs[i]->valid()) {
+        return inputs[i];
       }
     }
-    for (auto observer : _stickyOutputs) {
-      observer->signal(signalId);
-    }
-    if (cleanup) {
-      _clean();
-    }
+    return nullptr;
   }
 
-private:
-  void _clean() const {
-    _outputs.erase(
-      std::remove_if(
-        begin(_outputs),
-        end(_outputs),
-        [](auto ptr) { return ptr.expired(); }),
-      end(_outputs)
-    );
+  // Newest Var change any input reflects.
+  uint64_t inputsChanged() const {
+    return inputsChanged(typename gen_seq<sizeof...(Types)>::type());
   }
 
-  mutable std::vector<std::weak_ptr<Signallable>> _outputs;
-  mutable std::vector<std::shared_ptr<Signallable>> _stickyOutputs;
-};
+  template<int ...S>
+  uint64_t inputsChanged(seq<S...>) const {
+    uint64_t changed[] = { 0, std::get<S>(_inputs)->changed()... };
+    return *std::max_element(std::begin(changed), std::end(changed));
+  }
 
-template <typename R, typename... Types>
-class Routable :
-  public Signallable,
-  public Outputting<R> {
-public:
-  Routable(std::shared_ptr<Outputting<Types>>... inputs) : _inputs(std::tie(inputs...)) { }
+  template<int ...S>
+  void deactivate(seq<S...>) {
+    this->_header.active = false;
+    int dummy[] = { 0, (std::get<S>(_inputs)->requestCompaction(), 0)... };
+    static_cast<void>(dummy);
+  }
+
+  // Subscribes before marking the node active, so that inputs compacting
+  // their outputs drop the stale entry for this node.
+  template<int ...S>
+  void activate(std::vector<Node*>& inactive, seq<S...>) {
+    std::weak_ptr<Node> self = this->shared_from_this();
+    int dummy[] = { 0, (std::get<S>(_inputs)->attach(self), 0)... };
+    static_cast<void>(dummy);
+    Node* inputs[] = { nullptr, std::get<S>(_inputs).get()... };
+    for (size_t i = 1; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+      if (!inputs[i]->active()) {
+        inactive.push_back(inputs[i]);
+      }
+    }
+    this->_header.active = true;
+    static_cast<Derived*>(this)->reactivated();
+  }
 
-  virtual ~Routable() { }
+  template<int ...S>
+  bool replaceInput(const Node* from, const std::shared_ptr<Node>& to, seq<S...>) {
+    bool replaced[] = { false, replaceInput(std::get<S>(_inputs), from, to)... };
+    return std::find(std::begin(replaced), std::end(replaced), true) != std::end(replaced);
+  }
 
-  virtual void receivedSignal() = 0;
+  template <typename T>
+  static bool replaceInput(std::shared_ptr<Outputting<T>>& input, const Node* from, const std::shared_ptr<Node>& to) {
+    if (input.get() != from) {
+      return false;
+    }
+    input = std::static_pointer_cast<Outputting<T>>(to);
+    return true;
+  }
 
-  void signal(uint8_t signalId) {
-    if (signalId != lastReceivedSignalId) {
-      lastReceivedSignalId = signalId;
-      receivedSignal();
-      this->forwardSignal(signalId);
+  template<int ...S>
+  void releaseInputs(seq<S...>) {
+    std::shared_ptr<Node> inputs[] = { nullptr, std::move(std::get<S>(_inputs))... };
+    for (size_t i = 1; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+      detail::release(std::move(inputs[i]));
+    }
+  }
+
+  template<int ...S>
+  void visitInputs(const std::function<void(const Node*)>& visit, seq<S...>) const {
+    const Node* inputs[] = { nullptr, std::get<S>(_inputs).get()... };
+    for (size_t i = 1; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+      visit(inputs[i]);
     }
   }
 
-protected:
-  uint8_t lastReceivedSignalId = 0;
   std::tuple<std::shared_ptr<Outputting<Types>>...> _inputs;
 };
 
 template <class T>
 class Observer;
 
+// Critical observers always run at the end of the propagation that
+// reached them; normal ones may be postponed by a frame scheduler.
+enum class Priority { Normal, Critical };
+
 template <typename T>
 class Reactive {
 public:
@@ -122,17 +1230,26 @@ public:
   }
 
   template <typename F>
-  auto map(F func) {
+  auto map(F func) const {
     return reactives(*this).reduce(func);
   }
 
+  template <typename F, typename Policy>
+  auto map(F func, Policy policy) const {
+    return reactives(*this).reduce(func, policy);
+  }
+
   template <typename F>
-  void observe(F func) {
-    Observer<T>(func, *this);
+  void observe(F func, Priority priority = Priority::Normal) const {
+    Observer<T>(func, *this, priority);
   }
 
   T now() const {
-    return this->_node->now();
+    T value = this->_node->now();
+    if (this->_node->runtime().hasCacheBudget()) {
+      this->_node->runtime().trimCaches();
+    }
+    return value;
   }
 
   virtual ~Reactive() { }
@@ -142,20 +1259,80 @@ protected:
 };
 
 template <class T>
-class ObserverNode : public Signallable {
+class ObserverNode final :
+  public Node,
+  public Deferred,
+  public std::enable_shared_from_this<ObserverNode<T>> {
 public:
   ObserverNode(
+    Runtime& runtime,
     std::function<void(T)>&& func,
-    std::shared_ptr<Outputting<T>> input) : evaluate(func), input(input) { }
+    std::shared_ptr<Outputting<T>> input,
+    Priority priority) : Node(runtime), priority(priority), evaluate(func), input(input) {
+    // Changes are delivered relative to the value at subscription.
+    input->now();
+    delivered = input->changed();
+  }
+
+  void signal(uint32_t signalId) override {
+    if (!runtime().defersObservers()) {
+      run();
+    } else if (!queued) {
+      queued = true;
+      runtime().defer(this->shared_from_this());
+    }
+  }
+
+  bool postponable() const override {
+    return priority == Priority::Normal;
+  }
+
+  void run() override {
+    queued = false;
+    if (auto tmp = input.lock()) {
+      RX_TRACE_SCOPE(Observe, this);
+      #ifdef RX_PROFILE
+        auto start = std::chrono::steady_clock::now();
+      #endif
+      auto value = tmp->now();
+      // A change policy may have kept the value last delivered.
+      if (tmp->changed() != delivered) {
+        delivered = tmp->changed();
+        evaluate(std::move(value));
+      }
+      #ifdef RX_PROFILE
+        record(_stats, start);
+      #endif
+    }
+  }
+
+  Kind kind() const override {
+    return Kind::Observer;
+  }
 
-  void signal(uint8_t signalId) override {
+  void visitInputs(const std::function<void(const Node*)>& visit) const override {
     if (auto tmp = input.lock()) {
-      evaluate(tmp->now());
+      visit(tmp.get());
     }
   }
+
+#ifdef RX_PROFILE
+  NodeStats stats() const override {
+    return _stats;
+  }
+#endif
+
 private:
+  bool queued = false;
+  Priority priority;
+  // Change stamp of the input value last passed to the function, or read
+  // when subscribing.
+  uint64_t delivered;
   std::function<void(T)> evaluate;
   std::weak_ptr<Outputting<T>> input;
+#ifdef RX_PROFILE
+  NodeStats _stats;
+#endif
 };
 
 template <class T>
@@ -163,8 +1340,8 @@ class Observer {
 public:
   Observer() { }
 
-  Observer(std::function<void(T)>&& func, Reactive<T> input) :
-      _node(std::make_shared<ObserverNode<T>>(std::move(func), input.node())) {
+  Observer(std::function<void(T)>&& func, Reactive<T> input, Priority priority = Priority::Normal) :
+      _node(makeNode<ObserverNode<T>>(input.node()->runtime(), std::move(func), input.node(), priority)) {
 
     observe(input);
   }
@@ -176,66 +1353,400 @@ private:
   std::shared_ptr<ObserverNode<T>> _node;
 };
 
-template<int ...>
-struct seq {};
+namespace detail {
 
-template<int N, int ...S>
-struct gen_seq : gen_seq<N-1, N-1, S...> {};
+// Base of nodes that hand the committed value of their input to something
+// outside the graph. Each propagation that reaches the node calls
+// Derived::commit(value) once, after every node has been invalidated.
+template <typename Derived, typename T>
+class SinkNode :
+  public Node,
+  public Deferred,
+  public std::enable_shared_from_this<Derived> {
+public:
+  SinkNode(Runtime& runtime, std::shared_ptr<Outputting<T>> input) :
+    Node(runtime), input(input) { }
 
-template<int ...S>
-struct gen_seq<0, S...>{
-  typedef seq<S...> type;
+  void signal(uint32_t signalId) override {
+    if (!queued) {
+      queued = true;
+      runtime().defer(this->shared_from_this());
+    }
+  }
+
+  void run() override {
+    queued = false;
+    static_cast<Derived*>(this)->commit(input->now());
+  }
+
+  Kind kind() const override {
+    return Kind::Observer;
+  }
+
+  void visitInputs(const std::function<void(const Node*)>& visit) const override {
+    visit(input.get());
+  }
+
+  std::shared_ptr<Outputting<T>> input;
+
+private:
+  bool queued = false;
 };
 
-class RxException : public std::runtime_error {
-public:
-  explicit RxException(const char* what_arg) :
-    std::runtime_error(what_arg) {}
+}
+
+// Change policies decide whether a new value differs from the previous
+// one. A Var only propagates, and a derived node only passes a new value on
+// to its readers, when its policy reports a change; otherwise the previous
+// value is kept. Custom policies are types with a static
+// changed(previous, next).
+
+// Every assignment and evaluation is a change.
+struct AlwaysChanged {
+  template <typename T>
+  static bool changed(const T& previous, const T& next) {
+    return true;
+  }
+};
+
+// Compares with operator==.
+struct DeepEqual {
+  template <typename T>
+  static bool changed(const T& previous, const T& next) {
+    return !(previous == next);
+  }
+};
+
+// Compares std::hash values, for types that hash faster than they compare.
+// Colliding values are taken as unchanged.
+struct HashCompare {
+  template <typename T>
+  static bool changed(const T& previous, const T& next) {
+    return std::hash<T>()(previous) != std::hash<T>()(next);
+  }
+};
+
+namespace detail {
+
+template <typename T>
+const void* address(T* pointer) {
+  return pointer;
+}
+
+template <typename T>
+auto address(const T& pointer) -> decltype(static_cast<const void*>(pointer.get())) {
+  return pointer.get();
+}
+
+}
+
+// Compares the addresses of pointer-like values, for immutable data shared
+// by pointer.
+struct PointerIdentity {
+  template <typename T>
+  static bool changed(const T& previous, const T& next) {
+    return detail::address(previous) != detail::address(next);
+  }
+};
+
+// Ignores differences up to a tolerance given as a std::ratio, to suppress
+// floating point jitter. NaNs always count as changes.
+template <typename Tolerance = std::micro>
+struct Epsilon {
+  template <typename T>
+  static bool changed(const T& previous, const T& next) {
+    auto tolerance = T(Tolerance::num) / T(Tolerance::den);
+    return !(std::abs(next - previous) <= tolerance);
+  }
 };
 
+template <typename T>
+using ChangeTest = bool (*)(const T& previous, const T& next);
+
+// The policy's test for T; null for AlwaysChanged, which needs no call.
+template <typename Policy, typename T>
+ChangeTest<T> changeTest() {
+  if (std::is_same<Policy, AlwaysChanged>::value) {
+    return nullptr;
+  }
+  return [](const T& previous, const T& next) {
+    return Policy::changed(previous, next);
+  };
+}
+
 #ifdef DEBUG
-  int RX_EVALUATE_COUNT = 0;
+  // Shared by all runtimes, which may run on different threads.
+  std::atomic<int> RX_EVALUATE_COUNT { 0 };
 #endif
 
+namespace detail {
+
+// Identity of a function: its type, plus its address for function
+// pointers. Functors with state have no identity.
+template <typename F>
+bool functionIdentity(const F& func, uintptr_t& value,
+    typename std::enable_if<std::is_pointer<F>::value>::type* = nullptr) {
+  value = reinterpret_cast<uintptr_t>(func);
+  return true;
+}
+
+template <typename F>
+bool functionIdentity(const F& func, uintptr_t& value,
+    typename std::enable_if<!std::is_pointer<F>::value>::type* = nullptr) {
+  value = 0;
+  return std::is_empty<F>::value;
+}
+
+}
+
 template <typename R, typename... Types>
-class RxNode : public Routable<R, Types...> {
+class RxNode final : public Routable<RxNode<R, Types...>, R, Types...> {
 public:
-  RxNode(std::shared_ptr<Outputting<Types>>... inputs, std::function<R(Types...)> func) :
-      Routable<R, Types...>(inputs...),
-      _func(func) {
+  RxNode(Runtime& runtime, std::shared_ptr<Outputting<Types>>... inputs, std::function<R(Types...)> func) :
+      Routable<RxNode, R, Types...>(runtime, inputs...),
+      _cold(Allocator<Cold>(runtime).allocate(1)) {
+    new (_cold) Cold(this, std::move(func));
+  }
+
+  ~RxNode() {
+    if (auto evaluator = this->runtime().evaluator()) {
+      evaluator->destroyed(this);
+    }
+    if (this->runtime().hasCacheBudget()) {
+      this->runtime().forgetCache(&_cold->cacheEntry);
+    }
+    _cold->~Cold();
+    Allocator<Cold>(this->runtime()).deallocate(_cold, 1);
+  }
+
+  // Called once the node is subscribed again; it may have missed signals.
+  void reactivated() {
+    this->_header.recheck = true;
   }
 
   void receivedSignal() {
-    upToDate = false;
+    if (this->_header.upToDate) {
+      this->_header.upToDate = false;
+      if (auto evaluator = this->runtime().evaluator()) {
+        evaluator->invalidated(this);
+      }
+    }
+  }
+
+  // Inactive nodes are only known to be valid until the next Var change.
+  bool valid() const override {
+    if (this->_header.active && !this->_header.recheck) {
+      return this->_header.upToDate;
+    }
+    return this->_header.upToDate && checked == this->runtime().changeCount();
+  }
+
+  void refresh() const override {
+    detail::EvaluationScope scope;
+    now();
   }
 
-  R now() const {
-    if (!this->upToDate) {
+  R now() const override {
+    if (auto evaluator = this->runtime().evaluator()) {
+      evaluator->access();
+      if (detail::evaluationDepth() == 0) {
+        _read = this->runtime().changeCount() + 1;
+      }
+    }
+    if (!this->_header.active || this->_header.recheck) {
+      revalidate();
+    }
+    #ifdef RX_COUNTERS
+      if (this->_header.upToDate) {
+        this->runtime().counters().hits += 1;
+      }
+    #endif
+    if (!this->_header.upToDate) {
+      if (this->invalidInput()) {
+        detail::refreshInputs(this);
+      }
+      // Inputs may have kept their values, through an upstream change
+      // policy, since this node was invalidated.
+      auto seen = this->inputsChanged();
+      if (seen == _seen) {
+        this->_header.upToDate = true;
+        checked = this->runtime().changeCount();
+        return read(false);
+      }
+      RX_TRACE_SCOPE(Evaluate, this);
       #ifdef DEBUG
         RX_EVALUATE_COUNT += 1;
       #endif
-      cachedValue = evaluate();
-      upToDate = true;
+      #ifdef RX_COUNTERS
+        this->runtime().counters().evaluations += 1;
+      #endif
+      #ifdef RX_PROFILE
+        auto start = std::chrono::steady_clock::now();
+      #endif
+      R next = evaluate();
+      if (_seen == unevaluated || !_cold->changeTest || _cold->changeTest(this->_value, next)) {
+        this->_value = std::move(next);
+        this->_changed = seen;
+      }
+      _seen = seen;
+      this->_header.upToDate = true;
+      checked = this->runtime().changeCount();
+      #ifdef RX_PROFILE
+        record(_stats, start);
+      #endif
+      return read(true);
+    }
+    return read(false);
+  }
+
+  // Nodes with a change policy keep their value, which the policy compares
+  // the next one against.
+  void evict() const override {
+    if (this->runtime().hasCacheBudget()) {
+      this->runtime().forgetCache(&_cold->cacheEntry);
+    }
+    if (_cold->changeTest) {
+      return;
+    }
+    this->_value = R();
+    this->_header.upToDate = false;
+    _seen = unevaluated;
+  }
+
+  bool hot() const override {
+    return _read > checked;
+  }
+
+  detail::CacheEntry* cacheEntry() const override {
+    return &_cold->cacheEntry;
+  }
+
+  template <typename Policy>
+  void setChangePolicy() {
+    if (this->runtime().hasCacheBudget()) {
+      this->runtime().forgetCache(&_cold->cacheEntry);
+    }
+    _cold->changeTest = changeTest<Policy, R>();
+  }
+
+  Node::Kind kind() const override {
+    return Node::Kind::Rx;
+  }
+
+  template <typename F>
+  void setIdentity(const F& func) {
+    if (detail::functionIdentity(func, _cold->function)) {
+      _cold->functionType = &typeid(F);
+    }
+  }
+
+  // Nodes with a change policy may hold an older value than their function
+  // returns, so they have no identity.
+  bool identity(const std::type_info*& type, uintptr_t& function) const override {
+    type = _cold->functionType;
+    function = _cold->function;
+    return _cold->functionType != nullptr && !_cold->changeTest;
+  }
+
+  bool mergeInto(Node* canonical) override {
+    if (canonical == this || typeid(*canonical) != typeid(*this)) {
+      return false;
     }
-    return cachedValue;
+    // Consumers switching over may drop the last other reference.
+    auto self = this->shared_from_this();
+    std::shared_ptr<Node> target = static_cast<RxNode*>(canonical)->shared_from_this();
+    if (!this->redirectOutputs(target)) {
+      return false;
+    }
+    this->deactivate();
+    return true;
+  }
+
+#ifdef RX_PROFILE
+  NodeStats stats() const override {
+    return _stats;
   }
+#endif
 
 private:
+  // Without signals, the cached value is stale exactly when an input now
+  // reflects a newer Var change than it did when last evaluated.
+  void revalidate() const {
+    auto changes = this->runtime().changeCount();
+    if (this->_header.upToDate && checked != changes) {
+      if (this->invalidInput()) {
+        detail::refreshInputs(this);
+      }
+      if (this->inputsChanged() != _seen) {
+        this->_header.upToDate = false;
+      }
+    }
+    checked = changes;
+    if (this->_header.active) {
+      this->_header.recheck = false;
+    }
+  }
+
+  // Reads made while evaluating another node leave the cache budget alone,
+  // so that parallel workers do not contend on the runtime. Nodes with a
+  // change policy are never evicted, so they are not tracked either.
+  const R& read(bool evaluated) const {
+    if (this->runtime().hasCacheBudget() && !_cold->changeTest &&
+        (evaluated || detail::evaluationDepth() == 0)) {
+      this->runtime().cacheRead(&_cold->cacheEntry, CacheSize<R>::of(this->_value));
+    }
+    return this->_value;
+  }
+
   R evaluate() const {
+    detail::EvaluationScope scope;
     return callFunc(typename gen_seq<sizeof...(Types)>::type());
   }
 
   template<int ...S>
   R callFunc(seq<S...>) const {
 
-    return _func(std::get<S>(this->_inputs)->now() ...);
+    return _cold->func(std::get<S>(this->_inputs)->now() ...);
   }
 
-  mutable bool upToDate = false;
-  std::function<R(Types...)> _func;
-  mutable R cachedValue;
+  static constexpr uint64_t unevaluated = UINT64_MAX;
+
+  mutable uint64_t checked = 0;
+  // Change count, plus one, when the application last read the node.
+  mutable uint64_t _read = 0;
+  // Newest Var change the inputs reflected when last evaluated.
+  mutable uint64_t _seen = unevaluated;
+
+  // Members only touched on evaluation, by the cache budget and by the
+  // optimizer, kept out of line so that a cache hit stays within the
+  // node's first two cache lines.
+  struct Cold {
+    Cold(const RxNode* node, std::function<R(Types...)> func) :
+      cacheEntry { node }, func(std::move(func)) { }
+
+    detail::CacheEntry cacheEntry;
+    ChangeTest<R> changeTest = nullptr;
+    std::function<R(Types...)> func;
+    const std::type_info* functionType = nullptr;
+    uintptr_t function = 0;
+  };
+
+  Cold* _cold;
+#ifdef RX_PROFILE
+  mutable NodeStats _stats;
+#endif
 };
 
+// On 64-bit targets, the node header, an eight byte value and both output
+// lists fill exactly one cache line, and a derived node of ints stays
+// within 136 bytes.
+static_assert(sizeof(void*) != 8 || sizeof(Node) + 8 + 2 * sizeof(detail::EdgeList<std::weak_ptr<Node>>) == 64,
+  "the first cache line should hold the header, a small value and the output lists");
+#ifndef RX_PROFILE
+static_assert(sizeof(void*) != 8 || sizeof(RxNode<int, int>) <= 136,
+  "derived nodes should keep their cold members out of line");
+#endif
+
 template <typename ReturnType>
 class Rx : public Reactive<ReturnType> {
 public:
@@ -256,15 +1767,38 @@ class ReactiveTuple {
 public:
   ReactiveTuple(Reactive<Types>... inputs) : _inputs(std::tie(inputs...)) { }
 
+  const std::tuple<Reactive<Types>...>& inputs() const {
+    return _inputs;
+  }
+
   template <typename F>
   auto reduce(F func) {
     return reduce(func, typename gen_seq<sizeof...(Types)>::type());
   }
 
+  // Derives a node that only passes on values its change policy reports as
+  // changed.
+  template <typename F, typename Policy>
+  auto reduce(F func, Policy policy) {
+    auto r = reduce(func);
+    using R = decltype(r.now());
+    auto node = std::static_pointer_cast<RxNode<R, Types...>>(r.node());
+    node->template setChangePolicy<Policy>();
+    return r;
+  }
+
   template <typename F, int ...S>
   auto reduce(F func, seq<S...>) {
     using R = decltype(func(std::get<S>(_inputs).node()->now() ...));
-    auto p = std::make_shared<RxNode<R, Types...>>(std::get<S>(_inputs).node() ..., func);
+    auto& runtime = std::get<0>(_inputs).node()->runtime();
+    Runtime* runtimes[] = { &std::get<S>(_inputs).node()->runtime()... };
+    for (auto other : runtimes) {
+      if (other != &runtime) {
+        throw RxException("Inputs belong to different runtimes");
+      }
+    }
+    auto p = makeNode<RxNode<R, Types...>>(runtime, std::get<S>(_inputs).node() ..., func);
+    p->setIdentity(func);
 
     auto r = Rx<R>();
     r.create(p);
@@ -275,7 +1809,7 @@ public:
 
 private:
   std::tuple<Reactive<Types>...> _inputs;
-  std::shared_ptr<Signallable> node;
+  std::shared_ptr<Node> node;
 
   template <typename T>
   void setOutputs(const T& t) {
@@ -294,53 +1828,68 @@ auto reactives(Reactive<Types>... inputs) {
   return ReactiveTuple<Types...>(inputs...);
 }
 
-class Signal {
-public:
-  static Signal& instance() {
-    static Signal _instance;
-    return _instance;
-  }
-
-  Signal(Signal const&) = delete;
-  void operator=(Signal const&) = delete;
-
-  uint8_t nextSignalId() {
-    if (signalId == 0) {
-      signalId = 1;
-    }
-    return signalId++;
-  }
-private:
-  Signal() { }
-  uint8_t signalId = 1;
-};
-
 template <typename T>
 class VarNode : public Outputting<T> {
 public:
-  VarNode(T value) : _value(value) { }
+  VarNode(Runtime& runtime, T value, ChangeTest<T> test = changeTest<DeepEqual, T>()) :
+      Outputting<T>(runtime, value), _changeTest(test) { }
 
-  T now() const {
-    return _value;
+  T now() const override {
+    return this->_value;
+  }
+
+  Node::Kind kind() const override {
+    return Node::Kind::Var;
   }
 
   void set(T value) {
-    if (!(this->_value == value)) {
+    if (assign(value)) {
+      propagate(this->runtime().nextSignalId());
+    }
+  }
+
+  // Stores the value without propagating it. Returns whether it changed.
+  bool assign(T value) {
+    this->runtime().access();
+    if (!_changeTest || _changeTest(this->_value, value)) {
       this->_value = value;
-      this->forwardSignal(Signal::instance().nextSignalId());
+      this->_changed = this->runtime().nextChange();
+      return true;
     }
+    return false;
+  }
+
+  void propagate(uint32_t signalId) const {
+    RX_TRACE_SCOPE(Propagate, this);
+    Runtime::Propagation propagation(this->runtime());
+    this->forwardSignal(signalId);
+    propagation.end();
   }
+
 private:
-  T _value;
+  ChangeTest<T> _changeTest;
 };
 
 template <typename T>
 class VarT : public Reactive<T> {
 public:
-  VarT(T value) : Reactive<T>(std::make_shared<VarNode<T>>(value)) { }
+  VarT(T value) : VarT(Runtime::global(), value) { }
+
+  VarT(Runtime& runtime, T value) : Reactive<T>(makeNode<VarNode<T>>(runtime, value)) { }
+
+  template <typename Policy>
+  VarT(T value, Policy policy) : VarT(Runtime::global(), value, policy) { }
+
+  template <typename Policy>
+  VarT(Runtime& runtime, T value, Policy policy) :
+      Reactive<T>(makeNode<VarNode<T>>(runtime, value, changeTest<Policy, T>())) { }
 
   void set(T value) {
-    std::dynamic_pointer_cast<VarNode<T>>(this->_node)->set(value);
+    varNode()->set(value);
+  }
+
+  std::shared_ptr<VarNode<T>> varNode() const {
+    return std::static_pointer_cast<VarNode<T>>(this->_node);
   }
 
 #ifdef DEBUG
@@ -356,4 +1905,19 @@ VarT<T> Var(T value) {
   return VarT<T>(value);
 };
 
+template <typename T>
+VarT<T> Var(Runtime& runtime, T value) {
+  return VarT<T>(runtime, value);
+};
+
+template <typename T, typename Policy>
+VarT<T> Var(T value, Policy policy) {
+  return VarT<T>(value, policy);
+};
+
+template <typename T, typename Policy>
+VarT<T> Var(Runtime& runtime, T value, Policy policy) {
+  return VarT<T>(runtime, value, policy);
+};
+
 }
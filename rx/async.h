@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "../rx.h"
+#include "ingest.h"
+
+namespace rx {
+
+// Result of an asynchronous computation: the last completed value, and
+// whether a newer run is still in flight.
+template <typename T>
+struct Pending {
+  T value;
+  bool pending;
+
+  bool operator==(const Pending& other) const {
+    return pending == other.pending && value == other.value;
+  }
+};
+
+namespace detail {
+
+// Var-like node whose value is computed on an executor. Every committed
+// change of the input starts a new run; runs that have been superseded are
+// skipped if they have not started and discarded when they land.
+template <typename R, typename T>
+class AsyncNode final :
+  public VarNode<Pending<R>>,
+  public Deferred,
+  public std::enable_shared_from_this<AsyncNode<R, T>> {
+public:
+  AsyncNode(
+    Runtime& runtime,
+    std::shared_ptr<Outputting<T>> input,
+    Ingest& ingest,
+    std::function<void(std::function<void()>)> executor,
+    std::function<R(T)> func) :
+      VarNode<Pending<R>>(runtime, Pending<R> { R(), true }),
+      _input(input),
+      _posted(ingest.postQueue()),
+      _executor(std::move(executor)),
+      _func(std::move(func)),
+      _generation(std::make_shared<std::atomic<uint64_t>>(0)) {
+    this->_header.height = _input->height() + 1;
+  }
+
+  void signal(uint32_t signalId) override {
+    if (!_queued) {
+      _queued = true;
+      this->runtime().defer(this->shared_from_this());
+    }
+  }
+
+  // Starts a run for the committed input value.
+  void run() override {
+    _queued = false;
+    auto generation = _generation->fetch_add(1) + 1;
+    this->set(Pending<R> { this->now().value, true });
+
+    auto value = _input->now();
+    auto current = _generation;
+    auto func = _func;
+    auto posted = _posted;
+    std::weak_ptr<AsyncNode> self = this->shared_from_this();
+    _executor([=] {
+      if (current->load() != generation) {
+        return;
+      }
+      auto result = func(value);
+      auto queue = posted.lock();
+      if (!queue || current->load() != generation) {
+        return;
+      }
+      queue->post([self, generation, result] {
+        if (auto node = self.lock()) {
+          node->land(generation, result);
+        }
+      });
+    });
+  }
+
+  Node::Kind kind() const override {
+    return Node::Kind::Rx;
+  }
+
+  void visitInputs(const std::function<void(const Node*)>& visit) const override {
+    visit(_input.get());
+  }
+
+private:
+  void land(uint64_t generation, const R& result) {
+    if (generation == _generation->load()) {
+      this->set(Pending<R> { result, false });
+    }
+  }
+
+  bool _queued = false;
+  std::shared_ptr<Outputting<T>> _input;
+  // Results are dropped if the Ingest is gone by the time they land.
+  std::weak_ptr<PostQueue> _posted;
+  std::function<void(std::function<void()>)> _executor;
+  std::function<R(T)> _func;
+  std::shared_ptr<std::atomic<uint64_t>> _generation;
+};
+
+}
+
+// Maps a reactive through an expensive function without blocking readers.
+// Each committed change of the input hands func to the executor, any
+// callable taking a std::function<void()>. Results land on the graph
+// thread through ingest.drain(), which signals dependents. Until then
+// readers see the last completed value with pending set.
+template <typename T, typename Executor, typename F>
+auto mapAsync(const Reactive<T>& input, Ingest& ingest, Executor executor, F func) {
+  using R = decltype(func(input.now()));
+  auto& runtime = input.node()->runtime();
+  if (&ingest.runtime() != &runtime) {
+    throw RxException("Ingest belongs to a different runtime");
+  }
+  auto node = makeNode<detail::AsyncNode<R, T>>(
+    runtime, input.node(), ingest, std::function<void(std::function<void()>)>(executor), func);
+  input.node()->addOutput(node);
+  node->run();
+  return Reactive<Pending<R>>(node);
+}
+
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../rx.h"
+
+namespace rx {
+
+namespace detail {
+
+// Bounded single-producer single-consumer ring. Each side caches the other
+// side's index so that it only touches the shared line when it looks full
+// or empty.
+template <typename T>
+class SpscRing {
+public:
+  SpscRing(size_t capacity) : _slots(roundUp(capacity)), _mask(_slots.size() - 1) { }
+
+  bool push(const T& value) {
+    auto tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _cachedHead == _slots.size()) {
+      _cachedHead = _head.load(std::memory_order_acquire);
+      if (tail - _cachedHead == _slots.size()) {
+        return false;
+      }
+    }
+    _slots[tail & _mask] = value;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Pops everything queued and keeps only the newest value.
+  bool popLatest(T& value) {
+    auto head = _head.load(std::memory_order_relaxed);
+    if (head == _cachedTail) {
+      _cachedTail = _tail.load(std::memory_order_acquire);
+      if (head == _cachedTail) {
+        return false;
+      }
+    }
+    value = _slots[(_cachedTail - 1) & _mask];
+    _head.store(_cachedTail, std::memory_order_release);
+    return true;
+  }
+
+  size_t capacity() const {
+    return _slots.size();
+  }
+
+private:
+  static size_t roundUp(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  std::vector<T> _slots;
+  size_t _mask;
+  // Producer side.
+  std::atomic<size_t> _tail { 0 };
+  size_t _cachedHead = 0;
+  char _padding[64];
+  // Consumer side.
+  std::atomic<size_t> _head { 0 };
+  size_t _cachedTail = 0;
+};
+
+// Sends the committed value of a reactive into the ring once per revision.
+// While the ring is full, values go to an overflow slot instead, where each
+// one replaces the last, so the newest value always reaches the consumer.
+// Values are numbered so that the consumer never goes back to an older one.
+template <typename T>
+class BridgeNode final : public SinkNode<BridgeNode<T>, T> {
+public:
+  BridgeNode(Runtime& runtime, std::shared_ptr<Outputting<T>> input, size_t capacity) :
+    SinkNode<BridgeNode, T>(runtime, input), ring(capacity) { }
+
+  // Called on the source thread.
+  void commit(const T& value) {
+    Entry entry { ++_sent, value };
+    if (!_overflowed.load(std::memory_order_acquire) && ring.push(entry)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _overflow = std::move(entry);
+    _overflowed.store(true, std::memory_order_release);
+  }
+
+  // Called on the target thread. Takes the newest value not received yet.
+  bool receive(T& value) {
+    Entry entry;
+    auto received = ring.popLatest(entry);
+    if (_overflowed.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (!received || _overflow.sequence > entry.sequence) {
+        entry = std::move(_overflow);
+        received = true;
+      }
+      _overflowed.store(false, std::memory_order_relaxed);
+    }
+    if (!received || entry.sequence <= _received) {
+      return false;
+    }
+    _received = entry.sequence;
+    value = std::move(entry.value);
+    return true;
+  }
+
+private:
+  struct Entry {
+    uint64_t sequence = 0;
+    T value;
+  };
+
+  SpscRing<Entry> ring;
+  uint64_t _sent = 0;
+  std::atomic<bool> _overflowed { false };
+  std::mutex _mutex;
+  Entry _overflow;
+  // Target side.
+  uint64_t _received = 0;
+};
+
+}
+
+// Mirrors a reactive from one runtime into a Var of another, so a graph can
+// be split across threads with only boundary values crossing between them.
+// The source runtime's thread sends each committed value; the target
+// runtime's thread calls drain(), which applies only the newest value
+// queued. Create the bridge on the source thread before the target thread
+// starts draining.
+template <typename T>
+class Bridge {
+public:
+  Bridge(const Reactive<T>& source, Runtime& target, size_t capacity = 64) :
+      _node(makeNode<detail::BridgeNode<T>>(source.node()->runtime(), source.node(), capacity)),
+      _output(target, source.now()) {
+    if (&source.node()->runtime() == &target) {
+      throw RxException("Bridge source and target share a runtime");
+    }
+    source.node()->addOutput(_node);
+  }
+
+  // The mirrored value, a Var of the target runtime. Must not be set
+  // directly.
+  const VarT<T>& output() const {
+    return _output;
+  }
+
+  // Applies the newest sent value, if any. Call from the target thread.
+  bool drain() {
+    T value;
+    if (!_node->receive(value)) {
+      return false;
+    }
+    _output.set(value);
+    return true;
+  }
+
+private:
+  std::shared_ptr<detail::BridgeNode<T>> _node;
+  VarT<T> _output;
+};
+
+template <typename T>
+Bridge<T> bridge(const Reactive<T>& source, Runtime& target, size_t capacity = 64) {
+  return Bridge<T>(source, target, capacity);
+}
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "../rx.h"
+
+namespace rx {
+
+// Spreads evaluation over frames for loops that cannot afford a long
+// update. Setting a Var only invalidates; critical observers still run at
+// the end of the propagation, while normal observers are queued and run by
+// runFrame() within a time budget, after hot nodes are brought up to date
+// lowest first. A node is hot if the application or an observer read it
+// since it last became valid; other nodes stay lazy. Work that does not fit
+// resumes in the next frame.
+//
+// Each observer reads the graph as of the moment it runs, so it may skip
+// revisions but never sees a mix of old and new values. Installs itself on
+// its runtime on construction, turning on observer deferral, and restores
+// both on destruction.
+class FrameScheduler : public Evaluator {
+public:
+  explicit FrameScheduler(Runtime& runtime = Runtime::global()) :
+      _runtime(runtime), _defersObservers(runtime.defersObservers()) {
+    _runtime.setEvaluator(this);
+    _runtime.setObserverDeferral(true);
+  }
+
+  // Runs any observers still queued.
+  ~FrameScheduler() {
+    _runtime.setEvaluator(nullptr);
+    _runtime.setObserverDeferral(_defersObservers);
+    _dirty.clear();
+    while (!_observers.empty()) {
+      auto work = _observers.front().lock();
+      _observers.pop_front();
+      if (work) {
+        work->run();
+      }
+    }
+  }
+
+  FrameScheduler(FrameScheduler const&) = delete;
+  void operator=(FrameScheduler const&) = delete;
+
+  void invalidated(const Node* node) override {
+    _dirty.insert(node);
+  }
+
+  void evaluate() override { }
+
+  // A node destroyed by an observer or node function during runFrame() is
+  // also dropped from the frame's order.
+  void destroyed(const Node* node) override {
+    _dirty.erase(node);
+    std::replace(begin(_order), end(_order), node, static_cast<const Node*>(nullptr));
+  }
+
+  bool postpone(const std::shared_ptr<Deferred>& work) override {
+    _observers.push_back(work);
+    return true;
+  }
+
+  // Evaluates and runs observers until the budget is spent, always making
+  // progress on at least one node or observer. Returns whether all work is
+  // done.
+  bool runFrame(std::chrono::nanoseconds budget) {
+    auto deadline = std::chrono::steady_clock::now() + budget;
+    auto spent = [&] { return std::chrono::steady_clock::now() >= deadline; };
+
+    // Nodes stay in the dirty set until evaluated, so ones destroyed between
+    // frames are forgotten.
+    _order.assign(begin(_dirty), end(_dirty));
+    std::sort(begin(_order), end(_order), [](const Node* a, const Node* b) {
+      return a->height() < b->height();
+    });
+    bool progressed = false;
+    for (size_t i = 0; i < _order.size(); i++) {
+      auto node = _order[i];
+      if (!node) {
+        continue;
+      }
+      if (progressed && spent()) {
+        _order.clear();
+        return false;
+      }
+      _dirty.erase(node);
+      if (!node->valid() && node->hot()) {
+        node->refresh();
+        progressed = true;
+      }
+    }
+    _order.clear();
+    while (!_observers.empty()) {
+      if (progressed && spent()) {
+        return false;
+      }
+      auto work = _observers.front().lock();
+      _observers.pop_front();
+      if (work) {
+        work->run();
+        progressed = true;
+      }
+    }
+    return true;
+  }
+
+  bool idle() const {
+    return _dirty.empty() && _observers.empty();
+  }
+
+private:
+  Runtime& _runtime;
+  bool _defersObservers;
+  std::unordered_set<const Node*> _dirty;
+  // Nodes to refresh in the current frame; empty between frames.
+  std::vector<const Node*> _order;
+  std::deque<std::weak_ptr<Deferred>> _observers;
+};
+
+}
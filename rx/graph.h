@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../rx.h"
+
+namespace rx {
+
+// Walks the live graph reachable from a set of roots and writes it out as
+// Graphviz DOT or JSON. Evaluation counts and times are only non-zero when
+// built with RX_PROFILE.
+class GraphExport {
+public:
+  template <typename T>
+  GraphExport& add(const Reactive<T>& reactive) {
+    _roots.push_back(reactive.node());
+    return *this;
+  }
+
+  template <typename T>
+  GraphExport& add(const Reactive<T>& reactive, std::string label) {
+    add(reactive);
+    _labels[reactive.node().get()] = std::move(label);
+    return *this;
+  }
+
+  GraphExport& withMetrics(bool metrics = true) {
+    _metrics = metrics;
+    return *this;
+  }
+
+  void writeDot(std::ostream& out) const {
+    auto graph = walk();
+    uint64_t hottest = 1;
+    for (const auto& node : graph.nodes) {
+      hottest = std::max(hottest, node.stats.evaluations);
+    }
+
+    out << "digraph rx {\n";
+    for (size_t i = 0; i < graph.nodes.size(); i++) {
+      const auto& node = graph.nodes[i];
+      out << "  n" << i << " [shape=" << shape(node.kind)
+          << ", label=\"" << labelFor(node, _metrics) << "\"";
+      if (_metrics) {
+        out << ", style=filled, fillcolor=\"0.0 "
+            << (double)node.stats.evaluations / hottest << " 1.0\"";
+      }
+      out << "];\n";
+    }
+    for (const auto& edge : graph.edges) {
+      out << "  n" << edge.from << " -> n" << edge.to
+          << (edge.sticky ? " [style=bold];\n" : " [style=dashed];\n");
+    }
+    out << "}\n";
+  }
+
+  void writeJson(std::ostream& out) const {
+    auto graph = walk();
+    out << "{\"nodes\":[";
+    for (size_t i = 0; i < graph.nodes.size(); i++) {
+      const auto& node = graph.nodes[i];
+      out << (i ? "," : "") << "{\"id\":" << i
+          << ",\"kind\":\"" << kindName(node.kind) << "\""
+          << ",\"label\":\"" << labelFor(node, false) << "\""
+          << ",\"outputs\":" << node.outputs;
+      if (_metrics) {
+        out << ",\"evaluations\":" << node.stats.evaluations
+            << ",\"nanoseconds\":" << node.stats.nanoseconds;
+      }
+      out << "}";
+    }
+    out << "],\"edges\":[";
+    for (size_t i = 0; i < graph.edges.size(); i++) {
+      const auto& edge = graph.edges[i];
+      out << (i ? "," : "") << "{\"from\":" << edge.from << ",\"to\":" << edge.to
+          << ",\"type\":\"" << (edge.sticky ? "sticky" : "weak") << "\"}";
+    }
+    out << "]}\n";
+  }
+
+  std::string dot() const {
+    std::ostringstream out;
+    writeDot(out);
+    return out.str();
+  }
+
+  std::string json() const {
+    std::ostringstream out;
+    writeJson(out);
+    return out.str();
+  }
+
+private:
+  struct Vertex {
+    const Node* node;
+    Node::Kind kind;
+    size_t outputs;
+    NodeStats stats;
+  };
+
+  struct Edge {
+    size_t from;
+    size_t to;
+    bool sticky;
+  };
+
+  struct Graph {
+    std::vector<Vertex> nodes;
+    std::vector<Edge> edges;
+  };
+
+  Graph walk() const {
+    Graph graph;
+    std::unordered_map<const Node*, size_t> ids;
+    std::vector<const Node*> pending;
+
+    auto discover = [&](const Node* node) {
+      auto it = ids.find(node);
+      if (it != ids.end()) {
+        return it->second;
+      }
+      auto id = graph.nodes.size();
+      ids[node] = id;
+      graph.nodes.push_back({ node, node->kind(), 0, node->stats() });
+      pending.push_back(node);
+      return id;
+    };
+
+    for (const auto& root : _roots) {
+      root->runtime().access();
+    }
+    for (const auto& root : _roots) {
+      discover(root.get());
+    }
+
+    while (!pending.empty()) {
+      auto node = pending.back();
+      pending.pop_back();
+      auto id = ids[node];
+
+      node->visitInputs([&](const Node* input) {
+        discover(input);
+      });
+      node->visitOutputs([&](const Node* output, bool sticky) {
+        auto to = discover(output);
+        graph.nodes[id].outputs += 1;
+        graph.edges.push_back({ id, to, sticky });
+      });
+    }
+    return graph;
+  }
+
+  std::string labelFor(const Vertex& vertex, bool metrics) const {
+    auto it = _labels.find(vertex.node);
+    std::string label = escape(it != _labels.end() ? it->second : kindName(vertex.kind));
+    if (metrics) {
+      std::ostringstream out;
+      out << label << "\\nevals=" << vertex.stats.evaluations
+          << " t=" << vertex.stats.nanoseconds / 1000 << "us";
+      label = out.str();
+    }
+    return label;
+  }
+
+  static const char* kindName(Node::Kind kind) {
+    switch (kind) {
+      case Node::Kind::Var: return "var";
+      case Node::Kind::Rx: return "rx";
+      case Node::Kind::Observer: return "observer";
+    }
+    return "";
+  }
+
+  static const char* shape(Node::Kind kind) {
+    switch (kind) {
+      case Node::Kind::Var: return "box";
+      case Node::Kind::Rx: return "ellipse";
+      case Node::Kind::Observer: return "diamond";
+    }
+    return "";
+  }
+
+  // Escapes for both JSON and DOT strings, neither of which may hold raw
+  // control characters.
+  static std::string escape(const std::string& in) {
+    std::string out;
+    for (auto c : in) {
+      switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+          if (static_cast<unsigned char>(c) < 0x20) {
+            char code[7];
+            std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+            out += code;
+          } else {
+            out += c;
+          }
+      }
+    }
+    return out;
+  }
+
+  // Held so that the roots outlive the Reactives they were added from;
+  // labels are keyed by the same nodes.
+  std::vector<std::shared_ptr<const Node>> _roots;
+  std::unordered_map<const Node*, std::string> _labels;
+  bool _metrics = false;
+};
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "../rx.h"
+
+namespace rx {
+
+// Refcounted handle to an immutable value, for payloads too large to copy
+// on every hop. Vars and nodes holding a Shared<T> cache the handle, so
+// reading or passing one on copies a pointer instead of the payload.
+// Comparing handles to the same payload skips the deep comparison. Changes
+// go through mutate() or with(), which copy the payload first if any other
+// handle still refers to it.
+template <typename T>
+class Shared {
+public:
+  Shared() : _value(std::make_shared<T>()) { }
+
+  Shared(T value) : _value(std::make_shared<T>(std::move(value))) { }
+
+  const T& operator*() const {
+    return *_value;
+  }
+
+  const T* operator->() const {
+    return _value.get();
+  }
+
+  const T* get() const {
+    return _value.get();
+  }
+
+  // Handles referring to the payload, this one included.
+  long useCount() const {
+    return _value.use_count();
+  }
+
+  // Mutable access to a payload only this handle refers to.
+  T& mutate() {
+    if (_value.use_count() != 1) {
+      _value = std::make_shared<T>(*_value);
+    } else {
+      // use_count() is a relaxed load. Another thread may have just dropped
+      // its handle, and its reads of the payload must happen before these
+      // writes.
+      std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *_value;
+  }
+
+  // Returns a copy of this handle with update applied to its payload.
+  template <typename F>
+  Shared with(F update) const {
+    Shared copy(*this);
+    update(copy.mutate());
+    return copy;
+  }
+
+  bool operator==(const Shared& other) const {
+    return _value == other._value || *_value == *other._value;
+  }
+
+  bool operator!=(const Shared& other) const {
+    return !(*this == other);
+  }
+
+private:
+  std::shared_ptr<T> _value;
+};
+
+template <typename T>
+Shared<T> share(T value) {
+  return Shared<T>(std::move(value));
+}
+
+// A payload shared by several handles is split between them. The split
+// uses the handles alive when a node's size is recorded, that is when it
+// is computed or read by the application, so it goes stale as other
+// handles come and go until the next such read.
+template <typename T>
+struct CacheSize<Shared<T>> {
+  static size_t of(const Shared<T>& value) {
+    return sizeof(value) + CacheSize<T>::of(*value) / value.useCount();
+  }
+};
+
+}
+
+namespace std {
+
+template <typename T>
+struct hash<rx::Shared<T>> {
+  size_t operator()(const rx::Shared<T>& value) const {
+    return hash<T>()(*value);
+  }
+};
+
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../rx.h"
+
+namespace rx {
+
+namespace detail {
+
+// Holds the latest value posted for one Var. Producers overwrite the value
+// and enqueue the slot only if it is not already queued, so the queue holds
+// each Var at most once no matter how fast it is written.
+class IngestSlot {
+public:
+  virtual ~IngestSlot() { }
+
+  // Moves the latest value into the Var without propagating it.
+  virtual bool apply() = 0;
+
+  virtual void propagate(uint32_t signalId) = 0;
+
+  std::atomic<bool> queued { false };
+
+  // Only touched by the draining thread.
+  bool batched = false;
+};
+
+// Each post swaps in a freshly allocated value, so producers and the
+// draining thread never wait on each other. A value replaced before it was
+// applied is freed by the producer that replaced it.
+template <typename T>
+class TypedIngestSlot : public IngestSlot {
+public:
+  TypedIngestSlot(std::shared_ptr<VarNode<T>> node) : _node(node) { }
+
+  ~TypedIngestSlot() {
+    delete _pending.load(std::memory_order_acquire);
+  }
+
+  void post(const T& value) {
+    delete _pending.exchange(new T(value), std::memory_order_acq_rel);
+  }
+
+  // The slot may have been queued again after its value was taken by an
+  // earlier apply, leaving nothing to apply.
+  bool apply() override {
+    std::unique_ptr<T> value(_pending.exchange(nullptr, std::memory_order_acq_rel));
+    return value && _node->assign(std::move(*value));
+  }
+
+  void propagate(uint32_t signalId) override {
+    _node->propagate(signalId);
+  }
+
+private:
+  std::shared_ptr<VarNode<T>> _node;
+  std::atomic<T*> _pending { nullptr };
+};
+
+// Bounded multi-producer single-consumer queue of slots (Vyukov style).
+class SlotQueue {
+public:
+  SlotQueue(size_t capacity) : _cells(capacity), _mask(capacity - 1) {
+    for (size_t i = 0; i < capacity; i++) {
+      _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(IngestSlot* slot) {
+    auto pos = _tail.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& cell = _cells[pos & _mask];
+      auto sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = (intptr_t)sequence - (intptr_t)pos;
+      if (diff == 0) {
+        if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.slot = slot;
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = _tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  IngestSlot* pop() {
+    auto& cell = _cells[_head & _mask];
+    if (cell.sequence.load(std::memory_order_acquire) != _head + 1) {
+      return nullptr;
+    }
+    auto slot = cell.slot;
+    cell.sequence.store(_head + _mask + 1, std::memory_order_release);
+    _head++;
+    return slot;
+  }
+
+  size_t capacity() const {
+    return _cells.size();
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    IngestSlot* slot;
+  };
+
+  std::vector<Cell> _cells;
+  size_t _mask;
+  std::atomic<size_t> _tail { 0 };
+  // Keeps the producers' tail and the consumer's head on separate lines.
+  char _padding[64];
+  size_t _head = 0;
+};
+
+// Functions posted for the propagation thread. Shared, so that work still
+// running elsewhere can hold on to it without outliving the Ingest.
+class PostQueue {
+public:
+  void post(std::function<void()> func) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _posted.push_back(std::move(func));
+  }
+
+  void run() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_posted.empty()) {
+        return;
+      }
+      _running.swap(_posted);
+    }
+    for (auto& func : _running) {
+      func();
+    }
+    _running.clear();
+  }
+
+private:
+  std::mutex _mutex;
+  std::vector<std::function<void()>> _posted;
+  std::vector<std::function<void()>> _running;
+};
+
+}
+
+template <typename T>
+class IngestWriter {
+public:
+  IngestWriter(detail::TypedIngestSlot<T>* slot, detail::SlotQueue* queue) :
+    _slot(slot), _queue(queue) { }
+
+  // Safe to call from any thread; never blocks on propagation.
+  void set(const T& value) {
+    _slot->post(value);
+    if (!_slot->queued.exchange(true, std::memory_order_acq_rel)) {
+      _queue->push(_slot);
+    }
+  }
+
+private:
+  detail::TypedIngestSlot<T>* _slot;
+  detail::SlotQueue* _queue;
+};
+
+// Thread-safe write path into the graph of one runtime. Any number of
+// producer threads set values through IngestWriters; a single propagation
+// thread calls drain(), which applies the latest value of every updated Var
+// and propagates the whole batch under one signal id.
+class Ingest {
+public:
+  // Capacity bounds the number of Vars that can be attached and is rounded
+  // up to a power of two.
+  explicit Ingest(size_t capacity = 1 << 12) : Ingest(Runtime::global(), capacity) { }
+
+  Ingest(Runtime& runtime, size_t capacity = 1 << 12) :
+      _runtime(runtime), _queue(roundUp(capacity)), _posted(std::make_shared<detail::PostQueue>()) {
+    _batch.reserve(_queue.capacity());
+  }
+
+  Ingest(Ingest const&) = delete;
+  void operator=(Ingest const&) = delete;
+
+  template <typename T>
+  IngestWriter<T> writer(const VarT<T>& var) {
+    if (&var.varNode()->runtime() != &_runtime) {
+      throw RxException("Var belongs to a different runtime");
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_slots.size() == _queue.capacity()) {
+      throw RxException("Ingest capacity exceeded");
+    }
+    auto slot = new detail::TypedIngestSlot<T>(var.varNode());
+    _slots.emplace_back(slot);
+    _attached.store(_slots.size(), std::memory_order_release);
+    return IngestWriter<T>(slot, &_queue);
+  }
+
+  Runtime& runtime() const {
+    return _runtime;
+  }
+
+  // Runs func on the propagation thread during the next drain. Safe to call
+  // from any thread.
+  void post(std::function<void()> func) {
+    _posted->post(std::move(func));
+  }
+
+  // Handle to the queue behind post(), for work that may outlive the
+  // Ingest. It expires with the Ingest.
+  std::weak_ptr<detail::PostQueue> postQueue() const {
+    return _posted;
+  }
+
+  // Runs posted functions, then applies queued updates, at most one per Var
+  // and at most maxBatch Vars, so a drain terminates even while producers
+  // keep writing. Must only be called from the propagation thread. Returns
+  // the number of Vars updated through writers.
+  size_t drain(size_t maxBatch = SIZE_MAX) {
+    _posted->run();
+    _batch.clear();
+    auto limit = std::min(maxBatch, _attached.load(std::memory_order_acquire));
+    for (size_t popped = 0; popped < limit; popped++) {
+      auto slot = _queue.pop();
+      if (!slot) {
+        break;
+      }
+      slot->queued.store(false, std::memory_order_release);
+      if (slot->apply() && !slot->batched) {
+        slot->batched = true;
+        _batch.push_back(slot);
+      }
+    }
+    if (!_batch.empty()) {
+      auto signalId = _runtime.nextSignalId();
+      for (auto slot : _batch) {
+        slot->batched = false;
+      }
+      Runtime::Propagation propagation(_runtime);
+      for (auto slot : _batch) {
+        slot->propagate(signalId);
+      }
+      propagation.end();
+    }
+    return _batch.size();
+  }
+
+private:
+  static size_t roundUp(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  Runtime& _runtime;
+  detail::SlotQueue _queue;
+  std::mutex _mutex;
+  std::vector<std::unique_ptr<detail::IngestSlot>> _slots;
+  std::atomic<size_t> _attached { 0 };
+  std::vector<detail::IngestSlot*> _batch;
+  std::shared_ptr<detail::PostQueue> _posted;
+};
+
+}
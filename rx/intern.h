@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "../rx.h"
+
+namespace rx {
+
+namespace detail {
+
+struct InternKey {
+  std::type_index type;
+  uintptr_t function;
+  std::vector<const Node*> inputs;
+
+  bool operator==(const InternKey& other) const {
+    return type == other.type && function == other.function && inputs == other.inputs;
+  }
+};
+
+struct InternKeyHash {
+  size_t operator()(const InternKey& key) const {
+    auto seed = key.type.hash_code() ^ std::hash<uintptr_t>()(key.function);
+    for (auto input : key.inputs) {
+      seed ^= std::hash<const Node*>()(input) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+  }
+};
+
+}
+
+// Opt-in table of derived nodes keyed by function and inputs. Building the
+// same map or reduce twice through an interner returns the first node, so
+// duplicates built by independent code are evaluated once. Entries do not
+// keep nodes alive.
+class Interner {
+public:
+  template <typename F, typename... Types>
+  auto reduce(ReactiveTuple<Types...> tuple, F func) {
+    return reduce(tuple, func, typename gen_seq<sizeof...(Types)>::type());
+  }
+
+  template <typename T, typename F>
+  auto map(const Reactive<T>& input, F func) {
+    return reduce(reactives(input), func);
+  }
+
+  // Number of nodes returned from the table instead of built.
+  uint64_t hits() const {
+    return _hits;
+  }
+
+  size_t size() const {
+    return _nodes.size();
+  }
+
+private:
+  template <typename F, typename... Types, int ...S>
+  auto reduce(ReactiveTuple<Types...>& tuple, F func, seq<S...>) {
+    using R = decltype(func(std::get<S>(tuple.inputs()).node()->now() ...));
+    using NodeType = RxNode<R, Types...>;
+
+    uintptr_t function;
+    if (!detail::functionIdentity(func, function)) {
+      return tuple.reduce(func);
+    }
+    detail::InternKey key {
+      std::type_index(typeid(F)),
+      function,
+      { std::get<S>(tuple.inputs()).node().get()... }
+    };
+
+    auto it = _nodes.find(key);
+    if (it != _nodes.end()) {
+      if (auto node = it->second.lock()) {
+        _hits++;
+        Rx<R> r;
+        r.create(std::static_pointer_cast<NodeType>(node));
+        return r;
+      }
+    }
+
+    auto r = tuple.reduce(func);
+    sweep();
+    _nodes[std::move(key)] = std::static_pointer_cast<Node>(r.node());
+    return r;
+  }
+
+  // Drops expired entries whenever the table has doubled since the last
+  // sweep.
+  void sweep() {
+    if (_nodes.size() < _sweepAt) {
+      return;
+    }
+    for (auto it = _nodes.begin(); it != _nodes.end();) {
+      if (it->second.expired()) {
+        it = _nodes.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    _sweepAt = std::max<size_t>(64, _nodes.size() * 2);
+  }
+
+  std::unordered_map<detail::InternKey, std::weak_ptr<Node>, detail::InternKeyHash> _nodes;
+  size_t _sweepAt = 64;
+  uint64_t _hits = 0;
+};
+
+}
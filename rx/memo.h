@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+
+#include "../rx.h"
+
+namespace rx {
+
+namespace detail {
+
+struct TupleHash {
+  template <typename... Types>
+  size_t operator()(const std::tuple<Types...>& key) const {
+    return hash(key, typename gen_seq<sizeof...(Types)>::type());
+  }
+
+  template <typename Tuple, int ...S>
+  static size_t hash(const Tuple& key, seq<S...>) {
+    size_t seed = 0;
+    int dummy[] = { 0, (combine(seed, std::get<S>(key)), 0)... };
+    static_cast<void>(dummy);
+    return seed;
+  }
+
+  template <typename T>
+  static void combine(size_t& seed, const T& value) {
+    seed ^= std::hash<T>()(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+  }
+};
+
+class MemoCacheBase {
+public:
+  virtual ~MemoCacheBase() { }
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+};
+
+// Least recently used results keyed by the argument tuple.
+template <typename Key, typename R>
+class MemoCache : public MemoCacheBase {
+public:
+  MemoCache(size_t capacity) : capacity(capacity) { }
+
+  // The cached result, or null. Valid until the next insert.
+  const R* find(const Key& key) {
+    auto it = index.find(key);
+    if (it == index.end()) {
+      misses++;
+      return nullptr;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, it->second);
+    return &it->second->second;
+  }
+
+  void insert(const Key& key, const R& result) {
+    if (index.count(key) || capacity == 0) {
+      return;
+    }
+    if (entries.size() == capacity) {
+      // Reuse the oldest entry.
+      index.erase(entries.back().first);
+      entries.splice(entries.begin(), entries, std::prev(entries.end()));
+      entries.front().first = key;
+      entries.front().second = result;
+    } else {
+      entries.emplace_front(key, result);
+    }
+    index.emplace(key, entries.begin());
+  }
+
+  size_t size() const {
+    return entries.size();
+  }
+
+private:
+  using Entries = std::list<std::pair<Key, R>>;
+
+  size_t capacity;
+  Entries entries;
+  std::unordered_map<Key, typename Entries::iterator, TupleHash> index;
+};
+
+}
+
+// Wraps a function in a bounded LRU cache keyed by its arguments, so that
+// inputs returning to an earlier state reuse the earlier result instead of
+// recomputing it. Arguments must be hashable and equality comparable. The
+// first call fixes the argument types; calling with other types throws.
+// Copies share one cache, which is safe to use from several threads.
+template <typename F>
+class Memo {
+public:
+  Memo(F func, size_t capacity) : _state(std::make_shared<State>(std::move(func), capacity)) { }
+
+  template <typename... Args>
+  auto operator()(const Args&... args) const -> decltype(std::declval<F&>()(args...)) {
+    using R = decltype(std::declval<F&>()(args...));
+    using Key = std::tuple<Args...>;
+    using Cache = detail::MemoCache<Key, R>;
+
+    Key key(args...);
+    {
+      std::lock_guard<std::mutex> lock(_state->mutex);
+      if (!_state->cache) {
+        _state->cache.reset(new Cache(_state->capacity));
+        _state->type = &typeid(Cache);
+      } else if (*_state->type != typeid(Cache)) {
+        throw RxException("Memo called with different argument types");
+      }
+      if (auto found = static_cast<Cache*>(_state->cache.get())->find(key)) {
+        return *found;
+      }
+    }
+    R result = _state->func(args...);
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    static_cast<Cache*>(_state->cache.get())->insert(key, result);
+    return result;
+  }
+
+  uint64_t hits() const {
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    return _state->cache ? _state->cache->hits : 0;
+  }
+
+  uint64_t misses() const {
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    return _state->cache ? _state->cache->misses : 0;
+  }
+
+private:
+  struct State {
+    State(F func, size_t capacity) : func(std::move(func)), capacity(capacity) { }
+
+    F func;
+    size_t capacity;
+    std::mutex mutex;
+    std::unique_ptr<detail::MemoCacheBase> cache;
+    const std::type_info* type = nullptr;
+  };
+
+  std::shared_ptr<State> _state;
+};
+
+template <typename F>
+Memo<F> memo(F func, size_t capacity) {
+  return Memo<F>(std::move(func), capacity);
+}
+
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <typeindex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../rx.h"
+#include "intern.h"
+
+namespace rx {
+
+// Nodes and edges that a change to every Var would signal, before and after
+// an optimizer run, and what the run did.
+struct OptimizeReport {
+  size_t nodesBefore = 0;
+  size_t nodesAfter = 0;
+  size_t edgesBefore = 0;
+  size_t edgesAfter = 0;
+  size_t removed = 0;
+  size_t merged = 0;
+  size_t fused = 0;
+};
+
+// Optimizes a graph once it is fully built, reachable from a set of roots:
+// the handles the application still reads. Three passes, in order:
+//
+// - Derived nodes that neither a root nor an observer depends on stop
+//   receiving signals. They are freed once their handles are.
+// - Derived nodes computing the same function of the same inputs are
+//   merged, so the value is evaluated once. Only functions with an
+//   identity qualify, as with the Interner.
+// - A derived node whose only consumer is another node is taken off the
+//   propagation path: the consumer subscribes to the node's inputs and
+//   pulls the whole chain in one evaluation step.
+//
+// Nodes taken off the propagation path validate themselves when read, so
+// any handle to them still reads the right value, and adding an observer
+// puts them back. Roots are never merged or fused.
+class GraphOptimizer {
+public:
+  template <typename T>
+  GraphOptimizer& add(const Reactive<T>& reactive) {
+    _roots.push_back(reactive.node());
+    return *this;
+  }
+
+  OptimizeReport run() {
+    for (const auto& root : _roots) {
+      root->runtime().access();
+    }
+    OptimizeReport report;
+    auto nodes = collect();
+    count(nodes, report.nodesBefore, report.edgesBefore);
+
+    report.removed = removeDead(nodes);
+    compact(nodes);
+    report.merged = mergeIdentical(nodes);
+    nodes = collect();
+    compact(nodes);
+    report.fused = fuseChains(nodes);
+    compact(nodes);
+
+    count(nodes, report.nodesAfter, report.edgesAfter);
+    return report;
+  }
+
+private:
+  // Every node connected to a root, inputs and outputs alike.
+  std::vector<Node*> collect() const {
+    std::unordered_set<const Node*> seen;
+    std::vector<const Node*> stack;
+    for (const auto& root : _roots) {
+      if (seen.insert(root.get()).second) {
+        stack.push_back(root.get());
+      }
+    }
+    std::vector<Node*> nodes;
+    while (!stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+      nodes.push_back(const_cast<Node*>(node));
+      auto visit = [&](const Node* next) {
+        if (seen.insert(next).second) {
+          stack.push_back(next);
+        }
+      };
+      node->visitInputs(visit);
+      node->visitOutputs([&](const Node* output, bool) { visit(output); });
+    }
+    return nodes;
+  }
+
+  // Nodes a change to every Var reaches, and the edges it travels.
+  static void count(const std::vector<Node*>& nodes, size_t& reached, size_t& edges) {
+    std::unordered_set<const Node*> seen;
+    std::vector<const Node*> stack;
+    for (auto node : nodes) {
+      if (node->kind() == Node::Kind::Var) {
+        seen.insert(node);
+        stack.push_back(node);
+      }
+    }
+    edges = 0;
+    while (!stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+      node->visitOutputs([&](const Node* output, bool) {
+        if (!output->active()) {
+          return;
+        }
+        edges++;
+        if (seen.insert(output).second) {
+          stack.push_back(output);
+        }
+      });
+    }
+    reached = seen.size();
+  }
+
+  static void compact(const std::vector<Node*>& nodes) {
+    for (auto node : nodes) {
+      node->compactOutputs();
+    }
+  }
+
+  bool isRoot(const Node* node) const {
+    for (const auto& root : _roots) {
+      if (root.get() == node) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Deactivates nodes that no root, observer or other node that keeps
+  // receiving signals depends on.
+  size_t removeDead(const std::vector<Node*>& nodes) const {
+    std::unordered_set<const Node*> live;
+    std::vector<const Node*> stack;
+    for (auto node : nodes) {
+      auto pinned = isRoot(node) ||
+        (node->kind() != Node::Kind::Var && !node->canDeactivate());
+      if (pinned && live.insert(node).second) {
+        stack.push_back(node);
+      }
+    }
+    while (!stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+      node->visitInputs([&](const Node* input) {
+        if (live.insert(input).second) {
+          stack.push_back(input);
+        }
+      });
+    }
+    size_t removed = 0;
+    for (auto node : nodes) {
+      if (!live.count(node) && node->canDeactivate() && node->active()) {
+        node->deactivate();
+        removed++;
+      }
+    }
+    return removed;
+  }
+
+  // Lowest first, so that consumers of merged nodes compare equal by the
+  // time they are reached. A merged node may be destroyed, so it is
+  // cleared from nodes.
+  size_t mergeIdentical(std::vector<Node*>& nodes) const {
+    std::sort(begin(nodes), end(nodes), [](const Node* a, const Node* b) {
+      return a->height() < b->height();
+    });
+    std::unordered_map<detail::InternKey, Node*, detail::InternKeyHash> canonical;
+    size_t merged = 0;
+    for (auto& node : nodes) {
+      const std::type_info* type;
+      uintptr_t function;
+      if (!node->canDeactivate() || !node->active() || !node->identity(type, function)) {
+        continue;
+      }
+      detail::InternKey key { std::type_index(*type), function, { } };
+      node->visitInputs([&](const Node* input) { key.inputs.push_back(input); });
+      auto it = canonical.find(key);
+      if (it == canonical.end()) {
+        canonical.emplace(std::move(key), node);
+        continue;
+      }
+      if (isRoot(node)) {
+        continue;
+      }
+      auto duplicate = node;
+      node = nullptr;
+      if (duplicate->mergeInto(it->second)) {
+        merged++;
+      }
+    }
+    nodes.erase(std::remove(begin(nodes), end(nodes), nullptr), end(nodes));
+    return merged;
+  }
+
+  // Highest first, so that a whole chain collapses onto its last consumer.
+  size_t fuseChains(std::vector<Node*>& nodes) const {
+    std::sort(begin(nodes), end(nodes), [](const Node* a, const Node* b) {
+      return a->height() > b->height();
+    });
+    size_t fused = 0;
+    for (auto node : nodes) {
+      if (!node->canDeactivate() || !node->active() || isRoot(node)) {
+        continue;
+      }
+      auto sole = node->soleOutput();
+      auto consumer = sole.lock();
+      if (!consumer) {
+        continue;
+      }
+      node->visitInputs([&](const Node* input) {
+        auto attached = false;
+        input->visitOutputs([&](const Node* output, bool) {
+          attached = attached || output == consumer.get();
+        });
+        if (!attached) {
+          input->attachOutput(sole);
+        }
+      });
+      node->deactivate();
+      fused++;
+    }
+    return fused;
+  }
+
+  std::vector<std::shared_ptr<Node>> _roots;
+};
+
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../rx.h"
+
+namespace rx {
+
+// Fixed size pool where every worker owns a deque of index ranges. Workers
+// take from the back of their own deque and steal from the front of others.
+// The calling thread works alongside the pool until the loop is done.
+class WorkStealingPool {
+public:
+  explicit WorkStealingPool(size_t threads) {
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; i++) {
+      _queues.emplace_back(new Queue());
+    }
+    // Queue 0 belongs to the calling thread.
+    for (size_t i = 1; i < threads; i++) {
+      _workers.emplace_back([this, i] { work(i); });
+    }
+  }
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+    }
+    _wake.notify_all();
+    for (auto& worker : _workers) {
+      worker.join();
+    }
+  }
+
+  WorkStealingPool(WorkStealingPool const&) = delete;
+  void operator=(WorkStealingPool const&) = delete;
+
+  size_t threads() const {
+    return _queues.size();
+  }
+
+  // Calls func(begin, end) over [0, count) in ranges of at most grain. If
+  // func throws, ranges not yet started are skipped and the first exception
+  // is rethrown on the calling thread once every range has finished.
+  void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& func) {
+    grain = std::max<size_t>(grain, 1);
+    auto ranges = (count + grain - 1) / grain;
+    if (ranges == 0) {
+      return;
+    }
+    _func = &func;
+    _failed.store(false, std::memory_order_relaxed);
+    _remaining.store(ranges, std::memory_order_release);
+    for (size_t i = 0; i < ranges; i++) {
+      auto& queue = *_queues[i % _queues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.ranges.push_back({ i * grain, std::min(count, (i + 1) * grain) });
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _generation++;
+    }
+    _wake.notify_all();
+
+    while (_remaining.load(std::memory_order_acquire) > 0) {
+      if (!runOne(0)) {
+        std::this_thread::yield();
+      }
+    }
+    _func = nullptr;
+    if (_failed.load(std::memory_order_acquire)) {
+      auto error = std::move(_error);
+      _error = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+  struct Range {
+    size_t begin;
+    size_t end;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Range> ranges;
+  };
+
+  void work(size_t index) {
+    uint64_t seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wake.wait(lock, [&] { return _stopping || _generation != seen; });
+        if (_stopping) {
+          return;
+        }
+        seen = _generation;
+      }
+      while (runOne(index)) { }
+    }
+  }
+
+  bool runOne(size_t index) {
+    Range range;
+    if (!take(index, range)) {
+      return false;
+    }
+    if (!_failed.load(std::memory_order_acquire)) {
+      try {
+        (*_func)(range.begin, range.end);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(_errorMutex);
+        if (!_error) {
+          _error = std::current_exception();
+          _failed.store(true, std::memory_order_release);
+        }
+      }
+    }
+    _remaining.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+  }
+
+  bool take(size_t index, Range& range) {
+    {
+      auto& own = *_queues[index];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.ranges.empty()) {
+        range = own.ranges.back();
+        own.ranges.pop_back();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < _queues.size(); i++) {
+      auto& victim = *_queues[(index + i) % _queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.ranges.empty()) {
+        range = victim.ranges.front();
+        victim.ranges.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<std::unique_ptr<Queue>> _queues;
+  std::vector<std::thread> _workers;
+  const std::function<void(size_t, size_t)>* _func = nullptr;
+  std::atomic<size_t> _remaining { 0 };
+  std::atomic<bool> _failed { false };
+  std::mutex _errorMutex;
+  std::exception_ptr _error;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  uint64_t _generation = 0;
+  bool _stopping = false;
+};
+
+// Evaluates every node invalidated by a propagation eagerly, one height
+// level at a time, with the nodes of a level spread over a work-stealing
+// pool. Propagations that invalidate fewer than minNodes nodes are left to
+// the usual lazy evaluation, as are levels smaller than grain which run on
+// the propagating thread.
+//
+// Installs itself on its runtime on construction and uninstalls on
+// destruction. Node functions must be safe to call concurrently with each
+// other.
+class ParallelEvaluator : public Evaluator {
+public:
+  explicit ParallelEvaluator(
+    size_t threads = std::thread::hardware_concurrency(),
+    size_t minNodes = 1024,
+    size_t grain = 256) : ParallelEvaluator(Runtime::global(), threads, minNodes, grain) { }
+
+  ParallelEvaluator(
+    Runtime& runtime,
+    size_t threads = std::thread::hardware_concurrency(),
+    size_t minNodes = 1024,
+    size_t grain = 256) :
+      _runtime(runtime), _pool(threads), _minNodes(minNodes), _grain(grain) {
+    _runtime.setEvaluator(this);
+  }
+
+  ~ParallelEvaluator() {
+    _runtime.setEvaluator(nullptr);
+  }
+
+  void invalidated(const Node* node) override {
+    _invalidated.push_back(node);
+  }
+
+  // Destroyed nodes are skipped, including ones a node function destroys
+  // while a level is evaluated on the propagating thread.
+  void destroyed(const Node* node) override {
+    std::replace(begin(_invalidated), end(_invalidated), node, static_cast<const Node*>(nullptr));
+  }
+
+  void evaluate() override {
+    _invalidated.erase(
+      std::remove(begin(_invalidated), end(_invalidated), nullptr),
+      end(_invalidated));
+    if (_invalidated.size() < _minNodes) {
+      _invalidated.clear();
+      return;
+    }
+
+    std::sort(begin(_invalidated), end(_invalidated), [](const Node* a, const Node* b) {
+      return a->height() < b->height();
+    });
+
+    // Nodes left unevaluated by a throwing function stay invalid and are
+    // evaluated lazily on their next read.
+    try {
+      size_t first = 0;
+      while (first < _invalidated.size()) {
+        if (!_invalidated[first]) {
+          first++;
+          continue;
+        }
+        auto height = _invalidated[first]->height();
+        auto last = first;
+        while (last < _invalidated.size() &&
+            (!_invalidated[last] || _invalidated[last]->height() == height)) {
+          last++;
+        }
+        evaluateLevel(first, last);
+        first = last;
+      }
+    } catch (...) {
+      _invalidated.clear();
+      throw;
+    }
+    _invalidated.clear();
+  }
+
+  size_t threads() const {
+    return _pool.threads();
+  }
+
+private:
+  void evaluateLevel(size_t first, size_t last) {
+    // Lower levels are already evaluated. Any input still invalid was not
+    // reached by this propagation and is shared state the workers would
+    // race on, so bring it up to date here first.
+    for (auto i = first; i < last; i++) {
+      if (auto node = _invalidated[i]) {
+        node->visitInputs([](const Node* input) {
+          if (!input->valid()) {
+            input->refresh();
+          }
+        });
+      }
+    }
+
+    if (last - first < _grain) {
+      for (auto i = first; i < last; i++) {
+        if (auto node = _invalidated[i]) {
+          node->refresh();
+        }
+      }
+      return;
+    }
+
+    _pool.parallelFor(last - first, _grain, [&](size_t begin, size_t end) {
+      for (auto i = begin; i < end; i++) {
+        if (auto node = _invalidated[first + i]) {
+          node->refresh();
+        }
+      }
+    });
+  }
+
+  Runtime& _runtime;
+  WorkStealingPool _pool;
+  size_t _minNodes;
+  size_t _grain;
+  std::vector<const Node*> _invalidated;
+};
+
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "../rx.h"
+
+namespace rx {
+
+template <typename T>
+struct Versioned {
+  T value;
+  uint64_t version;
+};
+
+namespace detail {
+
+// Seqlock over a small trivially copyable value. The value is stored as
+// relaxed atomic words so that torn reads are detected rather than racy.
+template <typename T>
+class SeqlockCell {
+public:
+  SeqlockCell(const T& value) {
+    store(value);
+  }
+
+  void store(const T& value) {
+    uint64_t words[kWords] = {};
+    std::memcpy(words, &value, sizeof(T));
+    auto sequence = _sequence.load(std::memory_order_relaxed);
+    _sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; i++) {
+      _words[i].store(words[i], std::memory_order_relaxed);
+    }
+    _version.store(_version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    _sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  Versioned<T> load() const {
+    uint64_t words[kWords];
+    uint64_t version;
+    for (;;) {
+      auto before = _sequence.load(std::memory_order_acquire);
+      if (before & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      for (size_t i = 0; i < kWords; i++) {
+        words[i] = _words[i].load(std::memory_order_relaxed);
+      }
+      version = _version.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (_sequence.load(std::memory_order_relaxed) == before) {
+        break;
+      }
+    }
+    Versioned<T> result { T(), version };
+    std::memcpy(&result.value, words, sizeof(T));
+    return result;
+  }
+
+private:
+  static const size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  std::atomic<uint64_t> _sequence { 0 };
+  std::atomic<uint64_t> _version { 0 };
+  std::atomic<uint64_t> _words[kWords];
+};
+
+// RCU style cell for large values: the writer fills a free slot and swaps
+// the current index; readers pin a slot only long enough to copy its
+// shared_ptr, so they never wait for the writer and never copy the value.
+//
+// The writer publishes the index and then checks pins; readers pin and then
+// check the index. Both sides are sequentially consistent, so either the
+// writer sees the pin or the reader sees the new index and backs off.
+template <typename T>
+class RcuCell {
+public:
+  RcuCell(const T& value) {
+    store(value);
+  }
+
+  void store(const T& value) {
+    auto current = _current.load(std::memory_order_relaxed);
+    auto next = current;
+    for (;;) {
+      next = (next + 1) % kSlots;
+      if (next == current) {
+        std::this_thread::yield();
+      } else if (_slots[next].readers.load(std::memory_order_seq_cst) == 0) {
+        break;
+      }
+    }
+    _slots[next].value = std::make_shared<const T>(value);
+    _slots[next].version = ++_version;
+    _current.store(next, std::memory_order_seq_cst);
+  }
+
+  Versioned<std::shared_ptr<const T>> share() const {
+    for (;;) {
+      auto index = _current.load(std::memory_order_acquire);
+      auto& slot = _slots[index];
+      slot.readers.fetch_add(1, std::memory_order_seq_cst);
+      if (_current.load(std::memory_order_seq_cst) == index) {
+        Versioned<std::shared_ptr<const T>> result { slot.value, slot.version };
+        slot.readers.fetch_sub(1, std::memory_order_release);
+        return result;
+      }
+      slot.readers.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  Versioned<T> load() const {
+    auto shared = share();
+    return { *shared.value, shared.version };
+  }
+
+private:
+  static const size_t kSlots = 4;
+
+  struct Slot {
+    mutable std::atomic<uint32_t> readers { 0 };
+    std::shared_ptr<const T> value;
+    uint64_t version = 0;
+  };
+
+  Slot _slots[kSlots];
+  std::atomic<size_t> _current { 0 };
+  uint64_t _version = 0;
+};
+
+template <typename T>
+using PublishCell = typename std::conditional<
+  std::is_trivially_copyable<T>::value && sizeof(T) <= 64,
+  SeqlockCell<T>,
+  RcuCell<T>>::type;
+
+template <typename T>
+class PublishNode final : public SinkNode<PublishNode<T>, T> {
+public:
+  PublishNode(Runtime& runtime, std::shared_ptr<Outputting<T>> input) :
+    SinkNode<PublishNode, T>(runtime, input), cell(input->now()) { }
+
+  void commit(const T& value) {
+    cell.store(value);
+  }
+
+  PublishCell<T> cell;
+};
+
+}
+
+// Last committed value of a reactive, readable from any thread without
+// locks while the graph thread keeps propagating. Create it on the graph
+// thread; values are committed at the end of each propagation that
+// reaches the reactive.
+template <typename T>
+class Published {
+public:
+  Published() { }
+
+  Published(const Reactive<T>& reactive) :
+      _node(makeNode<detail::PublishNode<T>>(reactive.node()->runtime(), reactive.node())) {
+    reactive.node()->addOutput(_node);
+  }
+
+  T read() const {
+    return _node->cell.load().value;
+  }
+
+  Versioned<T> readVersioned() const {
+    return _node->cell.load();
+  }
+
+  // Shared handle to the committed value, without copying it. Only
+  // available for values stored behind a pointer.
+  template <typename Cell = detail::PublishCell<T>>
+  auto share() const -> decltype(std::declval<const Cell&>().share()) {
+    return _node->cell.share();
+  }
+
+  // Number of values committed so far, including the initial one.
+  uint64_t version() const {
+    return _node->cell.load().version;
+  }
+
+private:
+  std::shared_ptr<detail::PublishNode<T>> _node;
+};
+
+template <typename T>
+Published<T> publish(const Reactive<T>& reactive) {
+  return Published<T>(reactive);
+}
+
+}
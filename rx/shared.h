@@ -0,0 +1,246 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+#include "../rx.h"
+#include "publish.h"
+
+namespace rx {
+
+namespace detail {
+
+// Layout of a shared-memory segment. Only address-free lock-free atomics
+// live here, so every process can map it at a different address.
+template <typename T>
+struct SharedLayout {
+  static const uint32_t kReady = 0x72787368;
+
+  SharedLayout(const T& value) : cell(value) { }
+
+  std::atomic<uint32_t> ready;
+  std::atomic<uint32_t> size;
+  // Bumped after every store; readers sleep on it with a futex.
+  std::atomic<uint32_t> updates;
+  SeqlockCell<T> cell;
+};
+
+// A POSIX shared-memory segment mapped into this process. The creator
+// constructs the layout and unlinks the name when it is destroyed. Creating
+// a segment under a name that exists fails rather than truncating a
+// mapping other processes may be using.
+template <typename T>
+class SharedSegment {
+public:
+  using Layout = SharedLayout<T>;
+
+  static_assert(std::is_trivially_copyable<T>::value, "Shared values must be trivially copyable");
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex word must be 32 bits");
+
+  static std::unique_ptr<SharedSegment> create(const std::string& name, const T& value) {
+    auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+      throw RxException("Shared memory segment already exists");
+    }
+    if (fd < 0) {
+      throw RxException("Could not create shared memory segment");
+    }
+    if (ftruncate(fd, sizeof(Layout)) != 0) {
+      close(fd);
+      shm_unlink(name.c_str());
+      throw RxException("Could not size shared memory segment");
+    }
+    std::unique_ptr<SharedSegment> segment(new SharedSegment(name, fd, true));
+    auto layout = new (segment->_layout) Layout(value);
+    layout->size.store(sizeof(T), std::memory_order_relaxed);
+    layout->updates.store(0, std::memory_order_relaxed);
+    layout->ready.store(Layout::kReady, std::memory_order_release);
+    return segment;
+  }
+
+  static std::unique_ptr<SharedSegment> open(const std::string& name) {
+    auto fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+      throw RxException("Could not open shared memory segment");
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size != sizeof(Layout)) {
+      close(fd);
+      throw RxException("Shared memory segment does not match the value type");
+    }
+    std::unique_ptr<SharedSegment> segment(new SharedSegment(name, fd, false));
+    auto layout = segment->layout();
+    while (layout->ready.load(std::memory_order_acquire) != Layout::kReady) {
+      std::this_thread::yield();
+    }
+    if (layout->size.load(std::memory_order_relaxed) != sizeof(T)) {
+      throw RxException("Shared memory segment does not match the value type");
+    }
+    return segment;
+  }
+
+  ~SharedSegment() {
+    if (_layout != MAP_FAILED) {
+      munmap(_layout, sizeof(Layout));
+    }
+    if (_owner) {
+      shm_unlink(_name.c_str());
+    }
+  }
+
+  SharedSegment(SharedSegment const&) = delete;
+  void operator=(SharedSegment const&) = delete;
+
+  Layout* layout() const {
+    return static_cast<Layout*>(_layout);
+  }
+
+  void store(const T& value) {
+    layout()->cell.store(value);
+    layout()->updates.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+    syscall(SYS_futex, futexWord(), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+  }
+
+  // Sleeps until the update count moves past seen or the timeout expires.
+  void wait(uint32_t seen, std::chrono::nanoseconds timeout) const {
+    if (layout()->updates.load(std::memory_order_acquire) != seen) {
+      return;
+    }
+#ifdef __linux__
+    struct timespec relative;
+    relative.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(timeout).count();
+    relative.tv_nsec = (timeout - std::chrono::seconds(relative.tv_sec)).count();
+    syscall(SYS_futex, futexWord(), FUTEX_WAIT, seen, &relative, nullptr, 0);
+#else
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (layout()->updates.load(std::memory_order_acquire) == seen &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+#endif
+  }
+
+private:
+  SharedSegment(const std::string& name, int fd, bool owner) : _name(name), _owner(owner) {
+    _layout = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_layout == MAP_FAILED) {
+      if (owner) {
+        shm_unlink(name.c_str());
+      }
+      throw RxException("Could not map shared memory segment");
+    }
+  }
+
+  uint32_t* futexWord() const {
+    return reinterpret_cast<uint32_t*>(&layout()->updates);
+  }
+
+  std::string _name;
+  bool _owner;
+  void* _layout = MAP_FAILED;
+};
+
+template <typename T>
+class SharedWriterNode final : public SinkNode<SharedWriterNode<T>, T> {
+public:
+  SharedWriterNode(
+    Runtime& runtime,
+    std::shared_ptr<Outputting<T>> input,
+    std::unique_ptr<SharedSegment<T>> segment) :
+      SinkNode<SharedWriterNode, T>(runtime, input), segment(std::move(segment)) { }
+
+  void commit(const T& value) {
+    segment->store(value);
+  }
+
+  std::unique_ptr<SharedSegment<T>> segment;
+};
+
+}
+
+// Writes every committed value of a reactive into a named POSIX shared
+// memory segment, where SharedVars in other processes pick it up. The
+// segment is removed when the writer is destroyed. Throws if the name is
+// already in use, including by a segment a crashed writer left behind.
+template <typename T>
+class SharedWriter {
+public:
+  SharedWriter(const Reactive<T>& reactive, const std::string& name) :
+      _node(makeNode<detail::SharedWriterNode<T>>(
+        reactive.node()->runtime(),
+        reactive.node(),
+        detail::SharedSegment<T>::create(name, reactive.now()))) {
+    reactive.node()->addOutput(_node);
+  }
+
+private:
+  std::shared_ptr<detail::SharedWriterNode<T>> _node;
+};
+
+template <typename T>
+SharedWriter<T> shareAs(const Reactive<T>& reactive, const std::string& name) {
+  return SharedWriter<T>(reactive, name);
+}
+
+// Var mirroring a shared memory segment written by another process. The
+// value is read straight from the mapping; nothing is copied through the
+// kernel. Call poll() or wait() from the runtime's thread to apply updates.
+template <typename T>
+class SharedVar {
+public:
+  explicit SharedVar(const std::string& name, Runtime& runtime = Runtime::global()) :
+      _segment(detail::SharedSegment<T>::open(name)),
+      _seen(_segment->layout()->updates.load(std::memory_order_acquire)),
+      _var(runtime, _segment->layout()->cell.load().value) { }
+
+  const VarT<T>& var() const {
+    return _var;
+  }
+
+  // Applies the latest value if the writer stored one since the last call.
+  bool poll() {
+    auto updates = _segment->layout()->updates.load(std::memory_order_acquire);
+    if (updates == _seen) {
+      return false;
+    }
+    _seen = updates;
+    _var.set(_segment->layout()->cell.load().value);
+    return true;
+  }
+
+  // Blocks until the writer stores a value or the timeout expires, then
+  // polls.
+  bool wait(std::chrono::nanoseconds timeout) {
+    _segment->wait(_seen, timeout);
+    return poll();
+  }
+
+private:
+  std::unique_ptr<detail::SharedSegment<T>> _segment;
+  uint32_t _seen;
+  VarT<T> _var;
+};
+
+}
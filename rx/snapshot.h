@@ -0,0 +1,197 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+
+#include "../rx.h"
+
+namespace rx {
+
+namespace detail {
+
+// Revisions pinned by live snapshots, shared by the registry, its tracked
+// nodes and every snapshot taken from it.
+class SnapshotState : public Deferred {
+public:
+  SnapshotState(Runtime& runtime) : runtime(runtime) { }
+
+  // Called on the graph thread once a revision and its deferred work are
+  // complete.
+  void run() override {
+    committed.store(runtime.currentRevision());
+  }
+
+  // Publishes the pin before re-reading the committed revision. If a commit
+  // slipped in between, the graph thread may already have trimmed with a
+  // floor newer than the pin, so pin the newer revision instead.
+  uint64_t pin() {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto revision = committed.load();
+    for (;;) {
+      pinned.insert(revision);
+      oldest.store(*pinned.begin());
+      auto check = committed.load();
+      if (check == revision) {
+        return revision;
+      }
+      pinned.erase(pinned.find(revision));
+      revision = check;
+    }
+  }
+
+  void unpin(uint64_t revision) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pinned.erase(pinned.find(revision));
+    oldest.store(pinned.empty() ? std::numeric_limits<uint64_t>::max() : *pinned.begin());
+  }
+
+  // No current or future snapshot pins a revision older than this. Must be
+  // called on the graph thread; sequentially consistent with pin().
+  uint64_t floor() const {
+    return std::min(oldest.load(), committed.load());
+  }
+
+  Runtime& runtime;
+  std::atomic<uint64_t> committed { 0 };
+
+private:
+  std::mutex mutex;
+  std::multiset<uint64_t> pinned;
+  std::atomic<uint64_t> oldest { std::numeric_limits<uint64_t>::max() };
+};
+
+// Keeps the values of one reactive for every revision a live snapshot may
+// still read. Older versions are dropped as soon as no snapshot can see them.
+template <typename T>
+class TrackedNode final : public SinkNode<TrackedNode<T>, T> {
+public:
+  TrackedNode(
+    Runtime& runtime,
+    std::shared_ptr<Outputting<T>> input,
+    std::shared_ptr<SnapshotState> state) : SinkNode<TrackedNode, T>(runtime, input), state(state) {
+    history.emplace_back(runtime.currentRevision(), input->now());
+  }
+
+  void commit(T value) {
+    auto revision = this->runtime().currentRevision();
+    auto floor = state->floor();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (history.back().first == revision) {
+      history.back().second = std::move(value);
+    } else {
+      history.emplace_back(revision, std::move(value));
+    }
+    while (history.size() > 1 && history[1].first <= floor) {
+      history.pop_front();
+    }
+  }
+
+  T read(uint64_t revision) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = history.rbegin(); it != history.rend(); ++it) {
+      if (it->first <= revision) {
+        return it->second;
+      }
+    }
+    throw RxException("Value not retained for snapshot revision");
+  }
+
+  size_t versions() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return history.size();
+  }
+
+private:
+  std::shared_ptr<SnapshotState> state;
+  mutable std::mutex mutex;
+  std::deque<std::pair<uint64_t, T>> history;
+};
+
+}
+
+template <typename T>
+class Tracked {
+public:
+  Tracked() { }
+
+  Tracked(std::shared_ptr<detail::TrackedNode<T>> node) : _node(node) { }
+
+  // Number of versions currently retained.
+  size_t versions() const {
+    return _node->versions();
+  }
+
+private:
+  friend class Snapshot;
+
+  std::shared_ptr<detail::TrackedNode<T>> _node;
+};
+
+// A consistent cut of every tracked reactive at one committed revision.
+// Snapshots may be taken, read and released from any thread.
+class Snapshot {
+public:
+  Snapshot(std::shared_ptr<detail::SnapshotState> state) :
+    _state(state), _revision(state->pin()) { }
+
+  ~Snapshot() {
+    if (_state) {
+      _state->unpin(_revision);
+    }
+  }
+
+  Snapshot(Snapshot&& other) : _state(std::move(other._state)), _revision(other._revision) { }
+
+  Snapshot(Snapshot const&) = delete;
+  void operator=(Snapshot const&) = delete;
+
+  template <typename T>
+  T read(const Tracked<T>& tracked) const {
+    return tracked._node->read(_revision);
+  }
+
+  uint64_t revision() const {
+    return _revision;
+  }
+
+private:
+  std::shared_ptr<detail::SnapshotState> _state;
+  uint64_t _revision;
+};
+
+// Registry of reactives of one runtime that snapshots can read. Reactives
+// must be tracked from the graph thread.
+class Snapshots {
+public:
+  Snapshots(Runtime& runtime = Runtime::global()) :
+      _state(std::make_shared<detail::SnapshotState>(runtime)) {
+    _state->committed.store(runtime.currentRevision());
+    runtime.addCommitListener(_state);
+  }
+
+  template <typename T>
+  Tracked<T> track(const Reactive<T>& reactive) {
+    if (&reactive.node()->runtime() != &_state->runtime) {
+      throw RxException("Reactive belongs to a different runtime");
+    }
+    auto node = makeNode<detail::TrackedNode<T>>(_state->runtime, reactive.node(), _state);
+    reactive.node()->addOutput(node);
+    return Tracked<T>(node);
+  }
+
+  Snapshot take() const {
+    return Snapshot(_state);
+  }
+
+private:
+  std::shared_ptr<detail::SnapshotState> _state;
+};
+
+}
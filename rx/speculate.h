@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "../rx.h"
+
+namespace rx {
+
+// Recomputes hot nodes on a background thread once a revision is
+// committed, so that the next read is a cache hit. A node is hot if the
+// application read it since it last became valid; reads by the worker or by
+// other nodes' functions do not count, and nodes nobody reads stay lazy.
+//
+// The graph thread never runs alongside the worker: assigning a Var,
+// reading, building or destroying nodes first stops the worker after the
+// node it is evaluating. Installs itself on its runtime on construction
+// and uninstalls on destruction. Node functions must be safe to call from
+// the worker thread.
+class Speculator : public Evaluator {
+public:
+  explicit Speculator(Runtime& runtime = Runtime::global(), size_t maxNodes = SIZE_MAX) :
+      _runtime(runtime),
+      _maxNodes(maxNodes),
+      _launcher(std::make_shared<Launcher>(this)) {
+    _runtime.setEvaluator(this);
+    _runtime.addCommitListener(_launcher);
+    _worker = std::thread([this] { work(); });
+  }
+
+  ~Speculator() {
+    access();
+    _runtime.setEvaluator(nullptr);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+    }
+    _wake.notify_all();
+    _worker.join();
+  }
+
+  Speculator(Speculator const&) = delete;
+  void operator=(Speculator const&) = delete;
+
+  void invalidated(const Node* node) override {
+    _dirty.insert(node);
+  }
+
+  void evaluate() override { }
+
+  void access() override {
+    if (onWorker() || !_busy.load(std::memory_order_acquire)) {
+      return;
+    }
+    _cancel.store(true, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idle.wait(lock, [this] { return !_busy.load(std::memory_order_relaxed); });
+    _cancel.store(false, std::memory_order_relaxed);
+  }
+
+  void destroyed(const Node* node) override {
+    access();
+    _dirty.erase(node);
+  }
+
+  // Blocks until the current speculation, if any, has finished.
+  void wait() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idle.wait(lock, [this] { return !_busy.load(std::memory_order_relaxed); });
+  }
+
+  // Number of nodes evaluated by the worker so far.
+  uint64_t evaluated() const {
+    return _evaluated.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Launcher : public Deferred {
+    Launcher(Speculator* owner) : owner(owner) { }
+
+    void run() override {
+      owner->launch();
+    }
+
+    Speculator* owner;
+  };
+
+  static bool& onWorker() {
+    static thread_local bool _onWorker = false;
+    return _onWorker;
+  }
+
+  // Runs on the graph thread after deferred work, so nodes read by
+  // observers are already valid and skipped.
+  void launch() {
+    access();
+    _work.clear();
+    for (auto node : _dirty) {
+      if (!node->valid() && node->hot()) {
+        _work.push_back(node);
+      }
+    }
+    _dirty.clear();
+    if (_work.empty()) {
+      return;
+    }
+    std::sort(begin(_work), end(_work), [](const Node* a, const Node* b) {
+      return a->height() < b->height();
+    });
+    if (_work.size() > _maxNodes) {
+      _work.resize(_maxNodes);
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _busy.store(true, std::memory_order_release);
+    }
+    _wake.notify_all();
+  }
+
+  void work() {
+    onWorker() = true;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wake.wait(lock, [this] { return _stopping || _busy.load(std::memory_order_relaxed); });
+        if (_stopping) {
+          return;
+        }
+      }
+      for (auto node : _work) {
+        if (_cancel.load(std::memory_order_relaxed)) {
+          break;
+        }
+        // A node whose function throws stays invalid, so the next read on
+        // the graph thread evaluates it again and sees the exception.
+        try {
+          node->refresh();
+          _evaluated.fetch_add(1, std::memory_order_relaxed);
+        } catch (...) { }
+      }
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _busy.store(false, std::memory_order_release);
+      }
+      _idle.notify_all();
+    }
+  }
+
+  Runtime& _runtime;
+  size_t _maxNodes;
+  std::shared_ptr<Launcher> _launcher;
+  std::unordered_set<const Node*> _dirty;
+  std::vector<const Node*> _work;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _idle;
+  std::atomic<bool> _busy { false };
+  std::atomic<bool> _cancel { false };
+  std::atomic<uint64_t> _evaluated { 0 };
+  bool _stopping = false;
+  std::thread _worker;
+};
+
+}
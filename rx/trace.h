@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rx {
+namespace trace {
+
+enum class Phase : uint8_t { Propagate, Evaluate, Observe };
+
+struct Record {
+  uint64_t nanoseconds;
+  const void* node;
+  Phase phase;
+  bool begin;
+};
+
+// Fixed size ring written only by its owning thread. Once full the oldest
+// records are overwritten. Each slot carries the index of the record it
+// holds, so readers skip slots that are overwritten while they copy them.
+class Ring {
+public:
+  Ring(size_t capacity, uint32_t threadId) :
+    _slots(capacity), _threadId(threadId) { }
+
+  void push(const Record& record) {
+    auto head = _head.load(std::memory_order_relaxed);
+    auto& slot = _slots[head % _slots.size()];
+    slot.index.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.nanoseconds.store(record.nanoseconds, std::memory_order_relaxed);
+    slot.node.store(record.node, std::memory_order_relaxed);
+    slot.phase.store(record.phase, std::memory_order_relaxed);
+    slot.begin.store(record.begin, std::memory_order_relaxed);
+    slot.index.store(head + 1, std::memory_order_release);
+    _head.store(head + 1, std::memory_order_release);
+  }
+
+  template <typename F>
+  void read(F func) const {
+    auto head = _head.load(std::memory_order_acquire);
+    auto first = head > _slots.size() ? head - _slots.size() : 0;
+    first = std::max(first, _cleared.load(std::memory_order_acquire));
+    std::vector<Record> copy;
+    copy.reserve(head - first);
+    for (auto i = first; i < head; i++) {
+      const auto& slot = _slots[i % _slots.size()];
+      if (slot.index.load(std::memory_order_acquire) != i + 1) {
+        continue;
+      }
+      Record record {
+        slot.nanoseconds.load(std::memory_order_relaxed),
+        slot.node.load(std::memory_order_relaxed),
+        slot.phase.load(std::memory_order_relaxed),
+        slot.begin.load(std::memory_order_relaxed)
+      };
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.index.load(std::memory_order_relaxed) == i + 1) {
+        copy.push_back(record);
+      }
+    }
+    for (const auto& record : copy) {
+      func(record);
+    }
+  }
+
+  // Hides the records pushed so far. The owning thread keeps writing, so
+  // the head is left alone.
+  void clear() {
+    _cleared.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+  uint32_t threadId() const {
+    return _threadId;
+  }
+
+private:
+  struct Slot {
+    // Index of the record held, plus one; zero while being written.
+    std::atomic<uint64_t> index { 0 };
+    std::atomic<uint64_t> nanoseconds { 0 };
+    std::atomic<const void*> node { nullptr };
+    std::atomic<Phase> phase { Phase::Propagate };
+    std::atomic<bool> begin { false };
+  };
+
+  std::vector<Slot> _slots;
+  std::atomic<uint64_t> _head { 0 };
+  std::atomic<uint64_t> _cleared { 0 };
+  uint32_t _threadId;
+};
+
+class Tracer {
+public:
+  static Tracer& instance() {
+    static Tracer _instance;
+    return _instance;
+  }
+
+  Tracer(Tracer const&) = delete;
+  void operator=(Tracer const&) = delete;
+
+  // Traces one in every `sampleEvery` top level propagations or reads. The
+  // capacity applies to rings created from now on; existing rings keep
+  // their size.
+  void enable(uint32_t sampleEvery = 1, size_t ringCapacity = 1 << 16) {
+    if (ringCapacity == 0) {
+      throw std::invalid_argument("Trace ring capacity must be positive");
+    }
+    _sampleEvery.store(sampleEvery ? sampleEvery : 1, std::memory_order_relaxed);
+    _ringCapacity.store(ringCapacity, std::memory_order_relaxed);
+    _enabled.store(true, std::memory_order_release);
+  }
+
+  void disable() {
+    _enabled.store(false, std::memory_order_release);
+  }
+
+  bool enabled() const {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& ring : _rings) {
+      ring->clear();
+    }
+  }
+
+  void writeJson(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    out << "{\"traceEvents\":[";
+    auto first = true;
+    for (const auto& ring : _rings) {
+      ring->read([&](const Record& record) {
+        out << (first ? "" : ",") << "\n{\"name\":\"" << name(record.phase)
+            << "\",\"cat\":\"rx\",\"ph\":\"" << (record.begin ? "B" : "E")
+            << "\",\"ts\":" << record.nanoseconds / 1000 << "."
+            << record.nanoseconds % 1000 / 100
+            << ",\"pid\":1,\"tid\":" << ring->threadId()
+            << ",\"args\":{\"node\":\"" << record.node << "\"}}";
+        first = false;
+      });
+    }
+    out << "\n]}\n";
+  }
+
+  bool dump(const std::string& path) const {
+    std::ofstream out(path);
+    writeJson(out);
+    return out.good();
+  }
+
+  bool begin(Phase phase, const void* node) {
+    auto& state = threadState();
+    if (state.depth == 0) {
+      if (!enabled()) {
+        return false;
+      }
+      state.sampled = ++state.counter % _sampleEvery.load(std::memory_order_relaxed) == 0;
+    }
+    state.depth++;
+    if (state.sampled) {
+      ring(state).push({ timestamp(), node, phase, true });
+    }
+    return true;
+  }
+
+  void end(Phase phase, const void* node) {
+    auto& state = threadState();
+    state.depth--;
+    if (state.sampled) {
+      ring(state).push({ timestamp(), node, phase, false });
+    }
+  }
+
+private:
+  struct ThreadState {
+    std::shared_ptr<Ring> ring;
+    uint32_t depth = 0;
+    uint64_t counter = 0;
+    bool sampled = false;
+  };
+
+  Tracer() : _start(std::chrono::steady_clock::now()) { }
+
+  static ThreadState& threadState() {
+    static thread_local ThreadState state;
+    return state;
+  }
+
+  Ring& ring(ThreadState& state) {
+    if (!state.ring) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto capacity = _ringCapacity.load(std::memory_order_relaxed);
+      state.ring = std::make_shared<Ring>(capacity, (uint32_t)_rings.size() + 1);
+      _rings.push_back(state.ring);
+    }
+    return *state.ring;
+  }
+
+  uint64_t timestamp() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - _start).count();
+  }
+
+  static const char* name(Phase phase) {
+    switch (phase) {
+      case Phase::Propagate: return "propagate";
+      case Phase::Evaluate: return "evaluate";
+      case Phase::Observe: return "observe";
+    }
+    return "";
+  }
+
+  std::atomic<bool> _enabled { false };
+  std::atomic<uint32_t> _sampleEvery { 1 };
+  std::atomic<size_t> _ringCapacity { 1 << 16 };
+  std::chrono::steady_clock::time_point _start;
+  mutable std::mutex _mutex;
+  std::vector<std::shared_ptr<Ring>> _rings;
+};
+
+class Scope {
+public:
+  Scope(Phase phase, const void* node) :
+    _phase(phase), _node(node), _active(Tracer::instance().begin(phase, node)) { }
+
+  ~Scope() {
+    if (_active) {
+      Tracer::instance().end(_phase, _node);
+    }
+  }
+
+  Scope(Scope const&) = delete;
+  void operator=(Scope const&) = delete;
+
+private:
+  Phase _phase;
+  const void* _node;
+  bool _active;
+};
+
+}
+}
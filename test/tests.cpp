@@ -2,10 +2,37 @@
 #include "test/catch.hpp"
 
 #define DEBUG
+#define RX_PROFILE
+#define RX_TRACE
 #include "rx.h"
+#include "rx/graph.h"
+#include "rx/ingest.h"
+#include "rx/publish.h"
+#include "rx/parallel.h"
+#include "rx/snapshot.h"
+#include "rx/bridge.h"
+#include "rx/shared.h"
+#include "rx/async.h"
+#include "rx/speculate.h"
+#include "rx/frame.h"
+#include "rx/memo.h"
+#include "rx/intern.h"
+#include "rx/optimize.h"
+#include "rx/immutable.h"
+#include "bench/alloc_counter.h"
+
+#include <sys/wait.h>
 
 using namespace rx;
 
+namespace {
+
+int toBps(int price) {
+  return price * 100;
+}
+
+}
+
 TEST_CASE( "Vars can be set", "[Var]" ) {
   VarT<int> a = Var(0);
   REQUIRE( a.now() == 0 );
@@ -249,3 +276,1284 @@ TEST_CASE( "A signal should pass through a Reactive only once", "[Rx]" ) {
 
   REQUIRE( counter == 1 );
 }
+
+TEST_CASE( "Deferred observers see a consistent graph", "[Observer]" ) {
+  Runtime runtime;
+  runtime.setObserverDeferral(true);
+  VarT<int> input = Var(runtime, 1);
+
+  auto x = input.map([] (int in) {
+    return in * 10;
+  });
+
+  auto y = input.map([] (int in) {
+    return in;
+  });
+
+  auto xy = reactives(x, y).reduce([] (int x, int y) {
+    return x * y;
+  });
+
+  std::vector<int> observed;
+  xy.observe([&] (int value) {
+    observed.push_back(value);
+  });
+
+  input.set(2);
+  input.set(3);
+
+  REQUIRE( observed == std::vector<int>({ 40, 90 }) );
+}
+
+TEST_CASE( "Graphs can be exported with metrics", "[Graph]" ) {
+  VarT<int> input = Var(1);
+
+  Rx<int> r = input.map([] (int in) {
+    return in * 2;
+  });
+
+  int observed = 0;
+  r.observe([&] (int value) {
+    observed = value;
+  });
+
+  input.set(2);
+
+  GraphExport graph;
+  graph.add(input, "input").withMetrics();
+
+  auto json = graph.json();
+  REQUIRE( json.find("\"label\":\"input\"") != std::string::npos );
+  REQUIRE( json.find("\"kind\":\"rx\"") != std::string::npos );
+  REQUIRE( json.find("\"kind\":\"observer\"") != std::string::npos );
+  REQUIRE( json.find("\"type\":\"weak\"") != std::string::npos );
+  REQUIRE( json.find("\"type\":\"sticky\"") != std::string::npos );
+  REQUIRE( json.find("\"evaluations\":1") != std::string::npos );
+
+  auto dot = graph.dot();
+  REQUIRE( dot.find("digraph rx") == 0 );
+  REQUIRE( dot.find("n0 -> n1 [style=dashed]") != std::string::npos );
+
+  GraphExport labelled;
+  labelled.add(input, "a\tb\n\x01\"");
+  REQUIRE( labelled.json().find("\"label\":\"a\\tb\\n\\u0001\\\"\"") != std::string::npos );
+
+  // Roots stay alive after the Reactive they were added from is gone.
+  GraphExport dropped;
+  {
+    Rx<int> temporary = input.map([] (int in) {
+      return in + 1;
+    });
+    dropped.add(temporary, "temporary");
+  }
+  REQUIRE( dropped.json().find("\"label\":\"temporary\"") != std::string::npos );
+}
+
+TEST_CASE( "Propagations can be traced", "[Trace]" ) {
+  auto& tracer = trace::Tracer::instance();
+  tracer.clear();
+
+  VarT<int> input = Var(0);
+
+  Rx<int> r = input.map([] (int in) {
+    return in * 2;
+  });
+
+  r.observe([] (int value) { });
+
+  input.set(1);
+
+  std::ostringstream untraced;
+  tracer.writeJson(untraced);
+  REQUIRE( untraced.str().find("propagate") == std::string::npos );
+
+  tracer.enable();
+  input.set(2);
+  tracer.disable();
+
+  std::ostringstream traced;
+  tracer.writeJson(traced);
+  auto json = traced.str();
+  REQUIRE( json.find("{\"traceEvents\":[") == 0 );
+  REQUIRE( json.find("\"name\":\"propagate\",\"cat\":\"rx\",\"ph\":\"B\"") != std::string::npos );
+  REQUIRE( json.find("\"name\":\"observe\"") != std::string::npos );
+  REQUIRE( json.find("\"name\":\"evaluate\",\"cat\":\"rx\",\"ph\":\"E\"") != std::string::npos );
+
+  tracer.clear();
+  tracer.enable(2);
+  input.set(3);
+  input.set(4);
+  input.set(5);
+  input.set(6);
+  tracer.disable();
+
+  std::ostringstream sampled;
+  tracer.writeJson(sampled);
+  json = sampled.str();
+  size_t propagations = 0;
+  std::string begin = "\"name\":\"propagate\",\"cat\":\"rx\",\"ph\":\"B\"";
+  for (auto pos = json.find(begin); pos != std::string::npos; pos = json.find(begin, pos + 1)) {
+    propagations++;
+  }
+  REQUIRE( propagations == 2 );
+  tracer.clear();
+
+  // Rings are read and cleared while their thread keeps wrapping them.
+  tracer.enable(1, 8);
+  std::atomic<bool> done { false };
+  std::thread writer([&] {
+    Runtime runtime;
+    VarT<int> other = Var(runtime, 0);
+    Rx<int> doubled = other.map([] (int in) { return in * 2; });
+    doubled.observe([] (int value) { });
+    for (int i = 1; i <= 2000; i++) {
+      other.set(i);
+    }
+    done = true;
+  });
+  while (!done) {
+    std::ostringstream concurrent;
+    tracer.writeJson(concurrent);
+    REQUIRE( concurrent.str().find("{\"traceEvents\":[") == 0 );
+    tracer.clear();
+  }
+  writer.join();
+  tracer.disable();
+  tracer.clear();
+
+  REQUIRE_THROWS_AS( tracer.enable(1, 0), std::invalid_argument );
+  REQUIRE( !tracer.enabled() );
+}
+
+namespace {
+  size_t nodeAllocations = 0;
+  size_t edgeAllocations = 0;
+
+  void countAllocations(AllocationKind kind, size_t bytes, bool allocated) {
+    if (allocated) {
+      (kind == AllocationKind::Node ? nodeAllocations : edgeAllocations) += 1;
+    }
+  }
+}
+
+TEST_CASE( "Node and edge allocations are reported", "[Allocation]" ) {
+  nodeAllocations = 0;
+  edgeAllocations = 0;
+  Runtime::global().setAllocationCallback(countAllocations);
+
+  VarT<int> input = Var(0);
+
+  Rx<int> r = input.map([] (int in) {
+    return in * 2;
+  });
+
+  Runtime::global().setAllocationCallback(nullptr);
+
+  // The Var, the derived node and its out of line evaluation state.
+  REQUIRE( nodeAllocations == 3 );
+  REQUIRE( edgeAllocations == 1 );
+}
+
+TEST_CASE( "Steady state propagation does not allocate", "[Allocation]" ) {
+  VarT<int> input1 = Var(0);
+  VarT<int> input2 = Var(0);
+
+  Rx<int> r1 = input1.map([] (int in) {
+    return in * 2;
+  });
+
+  Rx<int> r2 = reactives(r1, input2).reduce([] (int a, int b) {
+    return a + b;
+  });
+
+  int observed = 0;
+  r2.observe([&] (int value) {
+    observed = value;
+  });
+
+  input1.set(1);
+
+  auto before = alloc_counter::counts();
+  for (int i = 2; i < 100; i++) {
+    input1.set(i);
+    input2.set(i);
+    r2.now();
+  }
+  auto after = alloc_counter::counts();
+
+  REQUIRE( after.allocations == before.allocations );
+  REQUIRE( observed == 99 * 3 );
+}
+
+TEST_CASE( "Vars can be set from multiple threads through an ingest queue", "[Ingest]" ) {
+  const int producers = 4;
+  const int updates = 10000;
+
+  Ingest ingest;
+  std::vector<VarT<int>> vars;
+  std::vector<IngestWriter<int>> writers;
+  for (int i = 0; i < producers; i++) {
+    vars.push_back(Var(0));
+    writers.push_back(ingest.writer(vars.back()));
+  }
+
+  Rx<int> sum = reactives(vars[0], vars[1], vars[2], vars[3]).reduce([] (int a, int b, int c, int d) {
+    return a + b + c + d;
+  });
+
+  int observed = 0;
+  sum.observe([&] (int value) {
+    observed = value;
+  });
+
+  std::atomic<int> running(producers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < producers; i++) {
+    threads.emplace_back([&, i] {
+      for (int value = 1; value <= updates; value++) {
+        writers[i].set(value);
+      }
+      running--;
+    });
+  }
+
+  size_t drained = 0;
+  while (running > 0) {
+    drained += ingest.drain();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  drained += ingest.drain();
+
+  REQUIRE( drained <= producers * updates );
+  REQUIRE( sum.now() == producers * updates );
+  REQUIRE( observed == producers * updates );
+  REQUIRE( ingest.drain() == 0 );
+}
+
+TEST_CASE( "Published values can be read while propagating", "[Publish]" ) {
+  VarT<int> input = Var(1);
+
+  Rx<std::pair<int, int>> small = input.map([] (int in) {
+    return std::make_pair(in, in * 2);
+  });
+
+  Rx<std::vector<int>> large = input.map([] (int in) {
+    return std::vector<int>(256, in);
+  });
+
+  auto publishedSmall = publish(small);
+  auto publishedLarge = publish(large);
+
+  REQUIRE( publishedSmall.read().second == 2 );
+  REQUIRE( publishedLarge.read()[0] == 1 );
+
+  std::atomic<bool> done(false);
+  std::atomic<bool> consistent(true);
+  std::thread reader([&] {
+    uint64_t lastVersion = 0;
+    while (!done) {
+      auto pair = publishedSmall.readVersioned();
+      auto vector = publishedLarge.read();
+      if (pair.value.second != pair.value.first * 2 || pair.version < lastVersion) {
+        consistent = false;
+      }
+      if (std::count(vector.begin(), vector.end(), vector[0]) != 256) {
+        consistent = false;
+      }
+      lastVersion = pair.version;
+    }
+  });
+
+  for (int i = 2; i <= 2000; i++) {
+    input.set(i);
+  }
+  done = true;
+  reader.join();
+
+  REQUIRE( consistent );
+  REQUIRE( publishedSmall.read().first == 2000 );
+  REQUIRE( publishedSmall.version() == 2000 );
+  REQUIRE( publishedLarge.read()[255] == 2000 );
+  REQUIRE( publishedLarge.share().value->size() == 256 );
+}
+
+TEST_CASE( "Snapshots read a consistent revision", "[Snapshot]" ) {
+  VarT<int> input = Var(1);
+
+  Rx<int> doubled = input.map([] (int in) {
+    return in * 2;
+  });
+
+  Snapshots snapshots;
+  auto a = snapshots.track(input);
+  auto b = snapshots.track(doubled);
+
+  {
+    auto before = snapshots.take();
+
+    input.set(2);
+    input.set(3);
+
+    auto after = snapshots.take();
+
+    REQUIRE( before.read(a) == 1 );
+    REQUIRE( before.read(b) == 2 );
+    REQUIRE( after.read(a) == 3 );
+    REQUIRE( after.read(b) == 6 );
+    REQUIRE( after.revision() > before.revision() );
+    REQUIRE( b.versions() == 3 );
+  }
+
+  input.set(4);
+
+  // Only the committed and the newest version stay once snapshots are gone.
+  REQUIRE( a.versions() == 2 );
+  REQUIRE( b.versions() == 2 );
+  REQUIRE( snapshots.take().read(b) == 8 );
+
+  std::atomic<bool> done(false);
+  std::atomic<bool> consistent(true);
+  std::thread reader([&] {
+    while (!done) {
+      auto snapshot = snapshots.take();
+      if (snapshot.read(b) != snapshot.read(a) * 2) {
+        consistent = false;
+      }
+    }
+  });
+
+  for (int i = 5; i < 2000; i++) {
+    input.set(i);
+  }
+  done = true;
+  reader.join();
+
+  REQUIRE( consistent );
+}
+
+TEST_CASE( "Invalidated nodes can be evaluated in parallel by level", "[Parallel]" ) {
+  ParallelEvaluator parallel(4, 100, 16);
+
+  VarT<int> input = Var(1);
+
+  std::vector<Rx<int>> level1;
+  for (int i = 0; i < 200; i++) {
+    level1.push_back(input.map([i] (int in) {
+      return in * i;
+    }));
+  }
+
+  std::vector<Rx<int>> level2;
+  for (int i = 0; i + 1 < 200; i++) {
+    level2.push_back(reactives(level1[i], level1[i + 1]).reduce([] (int a, int b) {
+      return a + b;
+    }));
+  }
+
+  for (auto& r : level2) {
+    r.now();
+  }
+
+  REQUIRE( level2[10].node()->height() == 2 );
+
+  input.set(2);
+
+  bool allValid = true;
+  for (auto& r : level2) {
+    allValid = allValid && r.node()->valid();
+  }
+  REQUIRE( allValid );
+  REQUIRE( level2[10].now() == 2 * 10 + 2 * 11 );
+
+  VarT<int> small = Var(1);
+  Rx<int> lazy = small.map([] (int in) {
+    return in + 1;
+  });
+  REQUIRE( lazy.now() == 2 );
+
+  small.set(2);
+
+  REQUIRE( !lazy.node()->valid() );
+  REQUIRE( lazy.now() == 3 );
+
+  // Exceptions thrown on workers reach the thread that propagated.
+  VarT<int> failing = Var(0);
+  std::vector<Rx<int>> checked;
+  for (int i = 0; i < 200; i++) {
+    checked.push_back(failing.map([i] (int in) {
+      if (in == 1 && i % 50 == 7) {
+        throw std::runtime_error("failed");
+      }
+      return in + i;
+    }));
+    checked.back().now();
+  }
+  auto published = publish(failing);
+
+  // Deferred work still runs for the propagation that threw.
+  REQUIRE_THROWS_AS( failing.set(1), std::runtime_error );
+  REQUIRE( published.read() == 1 );
+  REQUIRE_THROWS_AS( checked[7].now(), std::runtime_error );
+
+  failing.set(2);
+  REQUIRE( checked[7].now() == 9 );
+  REQUIRE( checked[199].now() == 201 );
+
+  // Nodes destroyed after they were invalidated are not evaluated.
+  Observer<int> dropper([&checked] (int) {
+    checked.clear();
+  }, failing);
+  failing.set(3);
+  REQUIRE( checked.empty() );
+}
+
+TEST_CASE( "Runtimes are independent graphs", "[Runtime]" ) {
+  Runtime first;
+  Runtime second;
+
+  VarT<int> a = Var(first, 1);
+  VarT<int> b = Var(second, 1);
+  Rx<int> doubled = a.map([] (int in) {
+    return in * 2;
+  });
+
+  REQUIRE( &doubled.node()->runtime() == &first );
+  REQUIRE_THROWS_AS( reactives(a, b).reduce([] (int x, int y) {
+    return x + y;
+  }), RxException );
+
+  a.set(2);
+  a.set(3);
+  REQUIRE( first.currentRevision() == 2 );
+  REQUIRE( second.currentRevision() == 0 );
+  REQUIRE( doubled.now() == 6 );
+
+  int sums[2] = { 0, 0 };
+  auto drive = [] (Runtime& runtime, int& sum) {
+    VarT<int> input = Var(runtime, 0);
+    Rx<int> tripled = input.map([] (int in) {
+      return in * 3;
+    });
+    tripled.observe([&sum] (int value) {
+      sum += value;
+    });
+    for (int i = 1; i <= 1000; i++) {
+      input.set(i);
+    }
+  };
+  std::thread one(drive, std::ref(first), std::ref(sums[0]));
+  std::thread two(drive, std::ref(second), std::ref(sums[1]));
+  one.join();
+  two.join();
+
+  REQUIRE( sums[0] == 3 * 500500 );
+  REQUIRE( sums[1] == 3 * 500500 );
+  REQUIRE( second.currentRevision() == 1000 );
+}
+
+TEST_CASE( "Runtimes stay usable after a node function or observer throws", "[Runtime]" ) {
+  Runtime runtime;
+  VarT<int> input = Var(runtime, 1);
+  Rx<int> checked = input.map([] (int in) {
+    if (in < 0) {
+      throw std::runtime_error("negative input");
+    }
+    return in;
+  });
+  auto published = publish(input);
+  Snapshots snapshots(runtime);
+  auto tracked = snapshots.track(input);
+  int seen = 0;
+  checked.observe([&seen] (int value) {
+    seen = value;
+  });
+
+  REQUIRE_THROWS_AS( input.set(-1), std::runtime_error );
+  REQUIRE( runtime.pendingSignals().empty() );
+  input.set(3);
+  REQUIRE( seen == 3 );
+  REQUIRE( published.read() == 3 );
+  REQUIRE( snapshots.take().read(tracked) == 3 );
+
+  // Deferred work that throws does not hold up later flushes either.
+  runtime.setObserverDeferral(true);
+  REQUIRE_THROWS_AS( input.set(-2), std::runtime_error );
+  input.set(4);
+  REQUIRE( seen == 4 );
+  REQUIRE( published.read() == 4 );
+  REQUIRE( snapshots.take().read(tracked) == 4 );
+  REQUIRE( runtime.currentRevision() == 4 );
+}
+
+TEST_CASE( "Bridges mirror a reactive into another runtime", "[Bridge]" ) {
+  Runtime source;
+  Runtime target;
+
+  VarT<int> input = Var(source, 1);
+  auto link = bridge(input.map([] (int in) {
+    return in * 10;
+  }), target, 2);
+  Rx<int> plusOne = link.output().map([] (int in) {
+    return in + 1;
+  });
+
+  REQUIRE( plusOne.now() == 11 );
+  REQUIRE( !link.drain() );
+
+  input.set(2);
+  input.set(3);
+  REQUIRE( link.drain() );
+  REQUIRE( plusOne.now() == 31 );
+  REQUIRE( target.currentRevision() == 1 );
+
+  // The ring holds two values; the newest still arrives when it is full.
+  for (int i = 4; i <= 8; i++) {
+    input.set(i);
+  }
+  REQUIRE( link.drain() );
+  REQUIRE( plusOne.now() == 81 );
+  REQUIRE( !link.drain() );
+  input.set(9);
+  REQUIRE( link.drain() );
+  REQUIRE( plusOne.now() == 91 );
+
+  VarT<int> counter = Var(source, 0);
+  auto across = bridge(counter, target);
+  std::atomic<bool> done { false };
+  bool increasing = true;
+  int last = 0;
+  std::thread consumer([&] {
+    for (;;) {
+      bool finished = done;
+      if (across.drain()) {
+        auto value = across.output().now();
+        increasing = increasing && value > last;
+        last = value;
+      } else if (finished) {
+        break;
+      }
+    }
+  });
+  for (int i = 1; i <= 10000; i++) {
+    counter.set(i);
+  }
+  done = true;
+  consumer.join();
+
+  REQUIRE( increasing );
+  REQUIRE( last == 10000 );
+}
+
+namespace {
+  struct Quote {
+    double bid;
+    double ask;
+
+    bool operator==(const Quote& other) const {
+      return bid == other.bid && ask == other.ask;
+    }
+  };
+}
+
+// Reader half of the SharedVar test, run in a freshly executed copy of the
+// test binary so that no threads from earlier test cases are inherited.
+TEST_CASE( "Shared var reader", "[.SharedVarReader]" ) {
+  auto name = getenv("MINIRX_SHARED_NAME");
+  REQUIRE( name != nullptr );
+
+  Runtime runtime;
+  SharedVar<Quote> quote(name, runtime);
+  Rx<double> spread = quote.var().map([] (Quote q) {
+    return q.ask - q.bid;
+  });
+  bool consistent = true;
+  for (int i = 0; i < 1000 && quote.var().now().bid < 199.5; i++) {
+    quote.wait(std::chrono::milliseconds(10));
+    consistent = consistent && spread.now() == 1.0;
+  }
+  REQUIRE( consistent );
+  REQUIRE( quote.var().now().bid == 199.5 );
+}
+
+TEST_CASE( "Shared vars mirror a reactive into another process", "[SharedVar]" ) {
+  auto name = "/minirx-test-" + std::to_string(getpid());
+
+  Runtime runtime;
+  VarT<double> mid = Var(runtime, 100.0);
+  auto quotes = mid.map([] (double m) {
+    return Quote { m - 0.5, m + 0.5 };
+  });
+  auto writer = shareAs(quotes, name);
+  REQUIRE_THROWS_AS( shareAs(quotes, name), RxException );
+
+  auto env = "MINIRX_SHARED_NAME=" + name;
+  char* envp[] = { &env[0], nullptr };
+  auto child = fork();
+  if (child == 0) {
+    execle("/proc/self/exe", "tests", "[.SharedVarReader]", "-r", "compact", (char*)nullptr, envp);
+    _exit(127);
+  }
+
+  for (int i = 101; i <= 200; i++) {
+    mid.set(i);
+  }
+  int status = 0;
+  waitpid(child, &status, 0);
+
+  REQUIRE( WIFEXITED(status) );
+  REQUIRE( WEXITSTATUS(status) == 0 );
+  REQUIRE_THROWS_AS( SharedVar<int>(name, runtime), RxException );
+  REQUIRE_THROWS_AS( SharedVar<Quote>("/minirx-missing", runtime), RxException );
+}
+
+TEST_CASE( "Async maps run off the graph thread and drop superseded runs", "[Async]" ) {
+  std::vector<std::function<void()>> queued;
+  auto executor = [&queued] (std::function<void()> task) {
+    queued.push_back(std::move(task));
+  };
+
+  Ingest ingest;
+  VarT<int> input = Var(2);
+  int runs = 0;
+  auto squared = mapAsync(input, ingest, executor, [&runs] (int in) {
+    runs++;
+    return in * in;
+  });
+  Rx<int> plusOne = squared.map([] (Pending<int> p) {
+    return p.value + 1;
+  });
+
+  REQUIRE( squared.now().pending );
+  REQUIRE( queued.size() == 1 );
+
+  queued[0]();
+  ingest.drain();
+  REQUIRE( !squared.now().pending );
+  REQUIRE( plusOne.now() == 5 );
+
+  input.set(3);
+  input.set(4);
+  REQUIRE( squared.now().pending );
+  REQUIRE( squared.now().value == 4 );
+
+  // The run for 3 was superseded before it started.
+  queued[1]();
+  queued[2]();
+  queued.clear();
+  ingest.drain();
+  REQUIRE( runs == 2 );
+  REQUIRE( plusOne.now() == 17 );
+
+  // A run that finishes after being superseded is discarded.
+  input.set(5);
+  queued[0]();
+  input.set(6);
+  ingest.drain();
+  REQUIRE( squared.now().pending );
+  REQUIRE( squared.now().value == 16 );
+  queued[1]();
+  ingest.drain();
+  REQUIRE( squared.now().value == 36 );
+  REQUIRE( !squared.now().pending );
+
+  // Runs that finish after their Ingest is gone are dropped.
+  queued.clear();
+  {
+    Ingest shortLived;
+    auto cubed = mapAsync(input, shortLived, executor, [] (int in) {
+      return in * in * in;
+    });
+    REQUIRE( queued.size() == 1 );
+  }
+  queued[0]();
+}
+
+TEST_CASE( "Hot nodes are recomputed in the background", "[Speculate]" ) {
+  Runtime runtime;
+  Speculator speculator(runtime);
+
+  auto graphThread = std::this_thread::get_id();
+  std::atomic<bool> evaluatedElsewhere { false };
+  VarT<int> input = Var(runtime, 1);
+  Rx<int> hot = input.map([&] (int in) {
+    evaluatedElsewhere = std::this_thread::get_id() != graphThread;
+    return in * 2;
+  });
+  Rx<int> cold = input.map([] (int in) {
+    return in * 3;
+  });
+
+  REQUIRE( hot.now() == 2 );
+  REQUIRE( !evaluatedElsewhere );
+
+  input.set(2);
+  speculator.wait();
+
+  REQUIRE( hot.node()->valid() );
+  REQUIRE( !cold.node()->valid() );
+  REQUIRE( evaluatedElsewhere );
+  REQUIRE( hot.now() == 4 );
+  REQUIRE( cold.now() == 6 );
+
+  // Writes, reads and destruction stop a speculation in progress.
+  std::atomic<int> slowRuns { 0 };
+  Rx<int> slow = input.map([&] (int in) {
+    slowRuns++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    return in + 1;
+  });
+  Rx<int> slower = slow.map([] (int in) {
+    return in * 10;
+  });
+  REQUIRE( slower.now() == 30 );
+
+  input.set(3);
+  input.set(4);
+  REQUIRE( slower.now() == 50 );
+  input.set(5);
+  slower = Rx<int>();
+  slow = Rx<int>();
+  speculator.wait();
+  REQUIRE( hot.now() == 10 );
+  REQUIRE( speculator.evaluated() >= 1 );
+
+  // Only reads by the application keep a node hot.
+  auto before = speculator.evaluated();
+  for (int i = 6; i < 106; i++) {
+    input.set(i);
+    speculator.wait();
+  }
+  REQUIRE( speculator.evaluated() - before <= 1 );
+
+  // Building and pinning nodes while the worker runs.
+  VarT<int> wide = Var(runtime, 0);
+  std::vector<Rx<int>> readers;
+  for (int i = 0; i < 50; i++) {
+    readers.push_back(wide.map([i] (int in) { return in + i; }));
+    readers.back().now();
+  }
+  for (int i = 1; i < 20; i++) {
+    wide.set(i);
+    readers.push_back(readers[i].map([] (int in) { return in * 2; }));
+    readers[i].node()->pin();
+    readers[i].now();
+  }
+  speculator.wait();
+  REQUIRE( readers.back().now() == 2 * (19 + 19) );
+
+  // Exceptions thrown on the worker surface on the next read instead.
+  Rx<int> failing = input.map([] (int in) {
+    if (in == 200) {
+      throw std::runtime_error("failed");
+    }
+    return in;
+  });
+  REQUIRE( failing.now() == 105 );
+  input.set(200);
+  speculator.wait();
+  REQUIRE( !failing.node()->valid() );
+  REQUIRE_THROWS_AS( failing.now(), std::runtime_error );
+  input.set(201);
+  REQUIRE( failing.now() == 201 );
+}
+
+TEST_CASE( "Frame scheduler spreads observers over frames", "[Frame]" ) {
+  Runtime runtime;
+  FrameScheduler scheduler(runtime);
+
+  VarT<float> time = Var(runtime, 0.0f);
+  Rx<float> position = time.map([] (float t) {
+    return t * 2.0f;
+  });
+  Rx<float> velocity = time.map([] (float t) {
+    return t * 4.0f;
+  });
+  Rx<float> energy = reactives(position, velocity).reduce([] (float p, float v) {
+    return p + v;
+  });
+
+  std::vector<float> critical;
+  std::vector<std::pair<float, float>> seen;
+  time.observe([&critical] (float t) {
+    critical.push_back(t);
+  }, Priority::Critical);
+  Rx<std::pair<float, float>> state = reactives(position, velocity).reduce([] (float p, float v) {
+    return std::make_pair(p, v);
+  });
+  state.observe([&seen] (std::pair<float, float> pv) {
+    seen.push_back(pv);
+  });
+  int energyRuns = 0;
+  energy.observe([&energyRuns] (float) {
+    energyRuns++;
+  });
+
+  time.set(1.0f);
+  REQUIRE( critical == std::vector<float>({ 1.0f }) );
+  REQUIRE( seen.empty() );
+  REQUIRE( !scheduler.idle() );
+
+  // A zero budget still makes progress one step at a time.
+  int frames = 0;
+  while (!scheduler.runFrame(std::chrono::nanoseconds(0))) {
+    frames++;
+    if (frames == 1) {
+      // Observing evaluated the nodes, so the first frame refreshes one.
+      REQUIRE( seen.size() + energyRuns == 0 );
+      time.set(2.0f);
+    }
+  }
+  REQUIRE( frames > 2 );
+  REQUIRE( critical == std::vector<float>({ 1.0f, 2.0f }) );
+
+  // Postponed observers may skip revisions but never mix them.
+  for (auto& pv : seen) {
+    REQUIRE( pv.second == pv.first * 2.0f );
+  }
+  REQUIRE( seen.back() == std::make_pair(4.0f, 8.0f) );
+  REQUIRE( energyRuns >= 1 );
+  REQUIRE( scheduler.idle() );
+
+  // Nodes only other nodes read stay lazy.
+  Rx<float> idle = time.map([] (float t) {
+    return t - 1.0f;
+  });
+  Rx<float> reader = idle.map([] (float t) {
+    return t * 3.0f;
+  });
+  reader.now();
+  reader = Rx<float>();
+
+  time.set(3.0f);
+  REQUIRE( scheduler.runFrame(std::chrono::milliseconds(100)) );
+  REQUIRE( seen.back() == std::make_pair(6.0f, 12.0f) );
+  REQUIRE( !idle.node()->valid() );
+  REQUIRE( idle.now() == 2.0f );
+
+  // A node function may destroy nodes queued later in the same frame.
+  Rx<float> doomed = position.map([] (float p) {
+    return p + 1.0f;
+  });
+  Rx<float> destroyer = time.map([&doomed] (float t) {
+    doomed = Rx<float>();
+    return t;
+  });
+  doomed.now();
+  destroyer.now();
+  time.set(4.0f);
+  REQUIRE( scheduler.runFrame(std::chrono::milliseconds(100)) );
+  REQUIRE( destroyer.now() == 4.0f );
+
+  // A runtime has a single evaluator.
+  REQUIRE_THROWS_AS( Speculator(runtime), RxException );
+  REQUIRE_THROWS_AS( ParallelEvaluator(runtime, 2), RxException );
+  REQUIRE_THROWS_AS( FrameScheduler(runtime), RxException );
+}
+
+TEST_CASE( "Deep chains propagate, evaluate and tear down without recursion", "[Deep]" ) {
+  const int depth = 200000;
+  VarT<int> input = Var(0);
+  Reactive<int> last = input;
+  for (int i = 0; i < depth; i++) {
+    last = last.map([] (int in) {
+      return in + 1;
+    });
+  }
+
+  int observed = -1;
+  last.observe([&observed] (int value) {
+    observed = value;
+  });
+
+  REQUIRE( last.now() == depth );
+
+  input.set(1);
+  REQUIRE( observed == depth + 1 );
+  REQUIRE( last.node()->height() == (uint32_t)depth );
+
+  last = Reactive<int>();
+  input.set(2);
+  REQUIRE( observed == depth + 1 );
+}
+
+TEST_CASE( "Unobserved nodes unsubscribe and revalidate when read", "[Cold]" ) {
+  Runtime runtime;
+  runtime.setColdNodeDeactivation(true);
+
+  VarT<int> input = Var(runtime, 1);
+  int evaluations = 0;
+  std::vector<Rx<int>> readers;
+  for (int i = 0; i < 100; i++) {
+    readers.push_back(input.map([i, &evaluations] (int in) {
+      evaluations++;
+      return in + i;
+    }));
+  }
+  Rx<int> doubled = readers[0].map([] (int in) {
+    return in * 2;
+  });
+  REQUIRE( doubled.now() == 2 );
+  REQUIRE( input.numObservers() == 100 );
+
+  // Nodes without subscribers drop out after the first signal reaches them.
+  input.set(2);
+  input.set(3);
+  input.set(4);
+  REQUIRE( input.numObservers() == 0 );
+  REQUIRE( !doubled.node()->active() );
+
+  evaluations = 0;
+  REQUIRE( doubled.now() == 8 );
+  REQUIRE( readers[5].now() == 9 );
+  REQUIRE( evaluations == 2 );
+  REQUIRE( doubled.now() == 8 );
+  REQUIRE( evaluations == 2 );
+
+  input.set(4);
+  REQUIRE( doubled.now() == 8 );
+  REQUIRE( evaluations == 2 );
+
+  // Observing a cold node subscribes it and everything upstream again.
+  std::vector<int> seen;
+  doubled.observe([&seen] (int value) {
+    seen.push_back(value);
+  });
+  REQUIRE( doubled.node()->active() );
+  REQUIRE( readers[0].node()->active() );
+  REQUIRE( input.numObservers() == 1 );
+
+  input.set(5);
+  input.set(6);
+  REQUIRE( seen == std::vector<int>({ 10, 12 }) );
+  REQUIRE( input.numObservers() == 1 );
+  REQUIRE( readers[5].now() == 11 );
+}
+
+TEST_CASE( "Memoized maps reuse results for earlier inputs", "[Memo]" ) {
+  VarT<int> regime = Var(1);
+  VarT<int> tenor = Var(10);
+  int computed = 0;
+  auto surface = memo([&computed] (int r, int t) {
+    computed++;
+    return r * 100 + t;
+  }, 2);
+  Rx<int> vol = reactives(regime, tenor).reduce(surface);
+
+  REQUIRE( vol.now() == 110 );
+  regime.set(2);
+  REQUIRE( vol.now() == 210 );
+  regime.set(1);
+  REQUIRE( vol.now() == 110 );
+  REQUIRE( computed == 2 );
+  REQUIRE( surface.hits() == 1 );
+  REQUIRE( surface.misses() == 2 );
+
+  // The least recently used entry, regime 2, is evicted.
+  regime.set(3);
+  REQUIRE( vol.now() == 310 );
+  regime.set(1);
+  REQUIRE( vol.now() == 110 );
+  regime.set(2);
+  REQUIRE( vol.now() == 210 );
+  REQUIRE( computed == 4 );
+
+  auto squared = memo([] (int in) {
+    return in * in;
+  }, 4);
+  Rx<int> sq = regime.map(squared);
+  REQUIRE( sq.now() == 4 );
+  REQUIRE( squared.misses() == 1 );
+  REQUIRE_THROWS_AS( squared(2L), RxException );
+
+  // Results need not be default constructible.
+  struct Boxed {
+    explicit Boxed(int value) : value(value) { }
+    int value;
+  };
+  auto boxed = memo([] (int in) {
+    return Boxed(in);
+  }, 2);
+  REQUIRE( boxed(3).value == 3 );
+  REQUIRE( boxed(3).value == 3 );
+  REQUIRE( boxed.hits() == 1 );
+}
+
+TEST_CASE( "Interned nodes are shared between identical maps", "[Intern]" ) {
+  Interner interner;
+  VarT<int> price = Var(3);
+  VarT<int> other = Var(4);
+
+  Rx<int> first = interner.map(price, toBps);
+  Rx<int> second = interner.map(price, toBps);
+  Rx<int> elsewhere = interner.map(other, toBps);
+  REQUIRE( first.node() == second.node() );
+  REQUIRE( first.node() != elsewhere.node() );
+
+  auto spread = [] (int a, int b) {
+    return b - a;
+  };
+  Rx<int> s1 = interner.reduce(reactives(price, other), spread);
+  Rx<int> s2 = interner.reduce(reactives(price, other), spread);
+  Rx<int> s3 = interner.reduce(reactives(other, price), spread);
+  REQUIRE( s1.node() == s2.node() );
+  REQUIRE( s1.node() != s3.node() );
+  REQUIRE( interner.hits() == 2 );
+
+  // Functors with state are built as usual.
+  int offset = 1;
+  Rx<int> c1 = interner.map(price, [offset] (int p) {
+    return p + offset;
+  });
+  Rx<int> c2 = interner.map(price, [offset] (int p) {
+    return p + offset;
+  });
+  REQUIRE( c1.node() != c2.node() );
+
+  // Entries do not keep nodes alive.
+  first = Rx<int>();
+  second = Rx<int>();
+  Rx<int> rebuilt = interner.map(price, toBps);
+  REQUIRE( rebuilt.now() == 300 );
+  REQUIRE( interner.hits() == 2 );
+}
+
+TEST_CASE( "Optimizer removes, merges and fuses nodes", "[Optimize]" ) {
+  VarT<int> price = Var(3);
+  auto increment = [] (int x) {
+    return x + 1;
+  };
+
+  Rx<int> first = price.map(toBps);
+  Rx<int> second = price.map(toBps);
+  Rx<int> sum = reactives(first, second).reduce([] (int a, int b) {
+    return a + b;
+  });
+  Rx<int> chain = sum.map(increment).map(increment);
+  Rx<int> last = chain.map(increment);
+  Rx<int> unused = price.map(increment);
+
+  int seen = 0;
+  last.observe([&] (int value) {
+    seen = value;
+  });
+
+  auto report = GraphOptimizer().add(price).run();
+  REQUIRE( report.nodesBefore == 9 );
+  REQUIRE( report.removed == 1 );
+  REQUIRE( report.merged == 1 );
+  REQUIRE( report.fused == 4 );
+  // The Var signals the last node directly, which signals its observer.
+  REQUIRE( report.nodesAfter == 3 );
+  REQUIRE( report.edgesAfter == 2 );
+
+  const int evaluateCount = RX_EVALUATE_COUNT;
+  price.set(4);
+  REQUIRE( seen == 803 );
+  REQUIRE( RX_EVALUATE_COUNT == evaluateCount + 5 );
+
+  // Handles to optimized nodes still read the right value.
+  REQUIRE( second.now() == 400 );
+  REQUIRE( unused.now() == 5 );
+  REQUIRE( chain.now() == 802 );
+
+  // Observing a fused node puts it back on the propagation path.
+  int chained = 0;
+  chain.observe([&] (int value) {
+    chained = value;
+  });
+  price.set(5);
+  REQUIRE( chained == 1002 );
+  REQUIRE( seen == 1003 );
+}
+
+TEST_CASE( "Caches beyond the budget are dropped least recently read first", "[Budget]" ) {
+  Runtime runtime;
+  VarT<int> size = Var(runtime, 1000);
+  auto filled = [] (int value) {
+    return [value] (int n) {
+      return std::vector<int>(n, value);
+    };
+  };
+  Rx<std::vector<int>> a = size.map(filled(1));
+  Rx<std::vector<int>> b = size.map(filled(2));
+  Rx<std::vector<int>> c = size.map(filled(3));
+
+  // Room for two of the three caches.
+  auto bytes = CacheSize<std::vector<int>>::of(std::vector<int>(1000));
+  runtime.setCacheBudget(2 * bytes + bytes / 2);
+
+  a.now();
+  b.now();
+  REQUIRE( runtime.cachedBytes() == 2 * bytes );
+  c.now();
+  REQUIRE( runtime.cachedBytes() == 2 * bytes );
+
+  // a was read least recently, so only it is recomputed.
+  int evaluateCount = RX_EVALUATE_COUNT;
+  REQUIRE( b.now()[0] == 2 );
+  REQUIRE( c.now()[0] == 3 );
+  REQUIRE( RX_EVALUATE_COUNT == evaluateCount );
+  REQUIRE( a.now()[0] == 1 );
+  REQUIRE( RX_EVALUATE_COUNT == evaluateCount + 1 );
+
+  // Pinned caches survive and leave the budget to the others.
+  a.node()->pin();
+  b.now();
+  c.now();
+  REQUIRE( runtime.cachedBytes() == 2 * bytes );
+  evaluateCount = RX_EVALUATE_COUNT;
+  REQUIRE( a.now()[0] == 1 );
+  REQUIRE( b.now()[0] == 2 );
+  REQUIRE( c.now()[0] == 3 );
+  REQUIRE( RX_EVALUATE_COUNT == evaluateCount );
+
+  // Evicted nodes still see changes.
+  size.set(10);
+  REQUIRE( a.now().size() == 10 );
+  REQUIRE( b.now().size() == 10 );
+  REQUIRE( c.now().size() == 10 );
+  REQUIRE( runtime.cachedBytes() <= 2 * bytes + bytes / 2 );
+
+  // Nodes with a change policy keep the value it compares against.
+  Runtime strict;
+  strict.setCacheBudget(0);
+  VarT<int> count = Var(strict, 1);
+  Rx<bool> odd = count.map([] (int n) {
+    return n % 2 == 1;
+  }, DeepEqual());
+  int oddChanges = 0;
+  odd.observe([&oddChanges] (bool) {
+    oddChanges++;
+  });
+  for (int i = 3; i < 9; i += 2) {
+    count.set(i);
+  }
+  REQUIRE( oddChanges == 0 );
+  count.set(10);
+  REQUIRE( oddChanges == 1 );
+}
+
+TEST_CASE( "Caches are not trimmed while a node is evaluating", "[Budget]" ) {
+  Runtime runtime;
+  VarT<int> size = Var(runtime, 1000);
+  Rx<std::vector<int>> inner = size.map([] (int n) {
+    return std::vector<int>(n, 1);
+  });
+  Rx<size_t> outer = size.map([inner] (int) {
+    return inner.now().size() + inner.now().size();
+  });
+  runtime.setCacheBudget(1);
+
+  int evaluateCount = RX_EVALUATE_COUNT;
+  REQUIRE( outer.now() == 2000 );
+  REQUIRE( RX_EVALUATE_COUNT == evaluateCount + 2 );
+  REQUIRE( runtime.cachedBytes() <= 1 );
+}
+
+TEST_CASE( "Change policies decide what counts as a change", "[Change]" ) {
+  VarT<double> level = Var(1.0, Epsilon<std::milli>());
+  int levelChanges = 0;
+  level.observe([&] (double) {
+    levelChanges++;
+  });
+  level.set(1.0005);
+  REQUIRE( levelChanges == 0 );
+  REQUIRE( level.now() == 1.0 );
+  level.set(1.01);
+  REQUIRE( levelChanges == 1 );
+
+  VarT<int> ticks = Var(0, AlwaysChanged());
+  int tickChanges = 0;
+  ticks.observe([&] (int) {
+    tickChanges++;
+  });
+  ticks.set(0);
+  REQUIRE( tickChanges == 1 );
+
+  VarT<std::string> name = Var(std::string("a"), HashCompare());
+  REQUIRE( name.varNode()->assign("b") );
+  REQUIRE( !name.varNode()->assign("b") );
+
+  auto shared = std::make_shared<int>(1);
+  VarT<std::shared_ptr<int>> handle = Var(shared, PointerIdentity());
+  REQUIRE( !handle.varNode()->assign(shared) );
+  REQUIRE( handle.varNode()->assign(std::make_shared<int>(1)) );
+
+  // A derived node whose value is unchanged cuts off its readers.
+  VarT<int> price = Var(1);
+  Rx<bool> positive = price.map([] (int p) {
+    return p > 0;
+  }, DeepEqual());
+  Rx<int> label = positive.map([] (bool p) {
+    return p ? 1 : -1;
+  });
+  REQUIRE( label.now() == 1 );
+  const int evaluateCount = RX_EVALUATE_COUNT;
+  price.set(2);
+  REQUIRE( label.now() == 1 );
+  REQUIRE( RX_EVALUATE_COUNT == evaluateCount + 1 );
+  price.set(-2);
+  REQUIRE( label.now() == -1 );
+  REQUIRE( RX_EVALUATE_COUNT == evaluateCount + 3 );
+
+  // Observers of a derived node are not called for values it rejects.
+  VarT<double> raw = Var(1.0);
+  Rx<double> smoothed = raw.map([] (double x) {
+    return x;
+  }, Epsilon<std::milli>());
+  std::vector<double> seen;
+  smoothed.observe([&] (double x) {
+    seen.push_back(x);
+  });
+  raw.set(1.0001);
+  raw.set(1.0002);
+  raw.set(1.0003);
+  REQUIRE( seen.empty() );
+  raw.set(1.5);
+  REQUIRE( seen == std::vector<double>({ 1.5 }) );
+}
+
+TEST_CASE( "Shared values pass handles instead of copies", "[Shared]" ) {
+  VarT<Shared<std::vector<int>>> blob = Var(share(std::vector<int>(1000, 1)));
+  Rx<Shared<std::vector<int>>> forwarded = blob.map([] (Shared<std::vector<int>> b) {
+    return b;
+  });
+  Rx<int> total = blob.map([] (Shared<std::vector<int>> b) {
+    int sum = 0;
+    for (auto value : *b) {
+      sum += value;
+    }
+    return sum;
+  });
+  REQUIRE( forwarded.now().get() == blob.now().get() );
+  REQUIRE( total.now() == 1000 );
+
+  // Updates copy the payload, leaving handles to the old one untouched.
+  auto before = blob.now();
+  auto after = before.with([] (std::vector<int>& values) {
+    values[0] = 1001;
+  });
+  REQUIRE( after.get() != before.get() );
+  REQUIRE( (*before)[0] == 1 );
+  blob.set(after);
+  REQUIRE( total.now() == 2000 );
+  REQUIRE( forwarded.now().get() == after.get() );
+
+  // Equal payloads do not propagate.
+  int changes = 0;
+  blob.observe([&] (Shared<std::vector<int>>) {
+    changes++;
+  });
+  blob.set(blob.now());
+  blob.set(share(*after));
+  REQUIRE( changes == 0 );
+
+  // A payload only one handle refers to is mutated in place.
+  Shared<int> single(1);
+  auto payload = single.get();
+  single.mutate() = 2;
+  REQUIRE( single.get() == payload );
+  REQUIRE( *single == 2 );
+}